@@ -8,7 +8,10 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 #include "cmd.h"
+#include "lexer.h"
+#include "output.h"
 
 // Constants
 #ifndef WORD_SIZE
@@ -37,100 +40,264 @@ void initCmd(struct Cmd * command)
 
 	memset(command->stdinFile, '\0', sizeof(command->redirStdin));
 	memset(command->stdoutFile, '\0', sizeof(command->redirStdout));
+	command->stdinFd = -1;
+	command->stdoutFd = -1;
+	command->stdoutAppend = 0;
+	command->numTee = 0;
+	command->teeStdout = 0;
+
+	initSched(&command->sched);
+	initLimits(&command->limits);
+	command->setEnv = NULL;
 }
 
 
+#ifdef LEXER_CHECK
 /*
- * PARSE COMMAND
+ * CHECK LEXER AGAINST OLD PARSER
+ * Build with -DLEXER_CHECK to compare the lexer's words with the old
+ * strtok() split, for lines the old parser understood
  * */
-void parseCmd(struct Cmd * command, char * line)
+static void checkLexer(char * line, struct TokenList * tokens)
 {
-	// Variables to parse command
-	char * components[MAX_COMPONENTS];	// All words/components in original command
-	char buffer[WORD_SIZE];				// Buffer to hold each word
-	int args = 0;						// Number of final arguments, not including redir/bg character
-	int i = 0;							// Counter
-	char * word = NULL;					// For strtok, getting each word
-	pid_t shellPid = getpid();			// The shell's pid, for replacement
+	char copy[WORD_SIZE * 16];
+	char expected[WORD_SIZE * 16];
+	char * components[MAX_COMPONENTS];
+	char * pidLoc = NULL;
+	char * word = NULL;
+	int args = 0;
+	int i = 0;
 
-	// Use strtok() to parse words from line received
-	word = strtok(line, " \n");
+	// Old parser had no quoting, so only plain lines can match
+	if(strpbrk(line, "'\"\\\t") != NULL || strlen(line) >= sizeof(copy))
+		return;
 
-	// Get all words from command
-	while(word != NULL)
+	strcpy(copy, line);
+	word = strtok(copy, " \n");
+	while(word != NULL && args < MAX_COMPONENTS)
 	{
-		components[args] = word;
-		args++;
+		// Operators glued to words were never split by the old parser
+		if(strpbrk(word, "<>&|") != NULL && strlen(word) > 1 && strcmp(">>", word))
+			return;
+		components[args++] = word;
 		word = strtok(NULL, " \n");
 	}
 
-	// Now loop through and act on arguments
+	if(args != tokens->count)
+	{
+		fprintf(stderr, "LEXER_CHECK: %d words, old parser had %d: %s", tokens->count, args, line);
+		return;
+	}
+
 	for(i = 0; i < args; i++)
 	{
-		// stdout redirection
-		if(!strcmp(">", components[i]))
+		// Old parser's $$ replacement
+		snprintf(expected, sizeof(expected), "%s", components[i]);
+		while((pidLoc = strstr(expected, "$$")) != NULL)
 		{
-			strcpy(command->stdoutFile, components[i+1]);
-			command->redirStdout = 1;
+			char tail[sizeof(expected)];
+			strcpy(tail, pidLoc + 2);
+			snprintf(pidLoc, sizeof(expected) - (pidLoc - expected), "%d%s", (int)getpid(), tail);
 		}
 
-		// stdin redirection
-		if(!strcmp("<", components[i]))
-		{
-			strcpy(command->stdinFile, components[i+1]);
-			command->redirStdin = 1;
-		}
+		if(strcmp(expected, tokens->tokens[i].text))
+			fprintf(stderr, "LEXER_CHECK: word %d is \"%s\", old parser had \"%s\": %s",
+					i, tokens->tokens[i].text, expected, line);
+	}
+}
+#endif
 
-		// Replace $$ with process ID
-		char * pidLoc;
-		while(pidLoc = strstr(components[i], "$$"))
+/*
+ * COPY WORD INTO ARGS
+ * */
+static void addArg(struct Cmd * command, int arg, const char * text)
+{
+	command->args[arg] = malloc(sizeof(char) * (strlen(text) + 1));
+	if(command->args[arg] == NULL) exit(5);
+	strcpy(command->args[arg], text);
+}
+
+/*
+ * PARSE COMMAND
+ * On a syntax error a message is printed and the command is left empty
+ * */
+void parseCmd(struct Cmd * command, char * line)
+{
+	const char * error = parseCmdQuiet(command, line);
+
+	if(error != NULL)
+		outPrintf("smallsh: %s\n", error);
+
+	// & is ignored in foreground-only mode
+	if(fgMode)
+		command->bgProc = 0;
+}
+
+/*
+ * PARSE COMMAND WITHOUT OUTPUT
+ * Doesn't touch shell state, so it's safe off the main thread
+ * A trailing & always sets bgProc, foreground-only mode is up to the caller
+ * Returns syntax error message, with the command left empty, or NULL
+ * */
+const char * parseCmdQuiet(struct Cmd * command, char * line)
+{
+	// Variables to parse command
+	struct TokenList tokens;			// All words/operators in original command
+	struct Token * tok = NULL;			// Current token
+	char * target = NULL;				// Redirect filename being set
+	const char * error = NULL;			// Syntax error message
+	int append = 0;						// tee -a given
+	int args = 0;						// Number of final arguments, not including redir/bg character
+	int i = 0;							// Counter
+
+	// Split line into tokens
+	initTokens(&tokens);
+	if(lexLine(&tokens, line, strlen(line)) != LEX_OK)
+		error = "unterminated quote";
+
+#ifdef LEXER_CHECK
+	if(error == NULL)
+		checkLexer(line, &tokens);
+#endif
+
+	// Create array of args used in exec()
+	// Big enough for every token, last arg is NULL
+	command->args = malloc(sizeof(char *) * (tokens.count + 1));
+	if(command->args == NULL) exit(5);
+
+	// Now loop through and act on tokens
+	for(i = 0; i < tokens.count && error == NULL; i++)
+	{
+		tok = &tokens.tokens[i];
+
+		switch(tok->type)
 		{
-			memset(buffer, '\0', sizeof(buffer));
+			// stdin/stdout redirection, filename is next word
+			// Each > or >> after the first adds another output
+			case TOK_LT:
+			case TOK_GT:
+			case TOK_GTGT:
+				if(i + 1 == tokens.count || tokens.tokens[i+1].type != TOK_WORD)
+				{
+					error = "missing filename for redirect";
+					break;
+				}
+				if(strlen(tokens.tokens[i+1].text) >= WORD_SIZE)
+				{
+					error = "redirect filename too long";
+					break;
+				}
+
+				if(tok->type == TOK_LT)
+				{
+					target = command->stdinFile;
+					command->redirStdin = 1;
+				}
+				else if(!command->redirStdout)
+				{
+					target = command->stdoutFile;
+					command->redirStdout = 1;
+					command->stdoutAppend = (tok->type == TOK_GTGT);
+				}
+				else if(command->numTee < MAX_TEE)
+				{
+					target = command->teeFile[command->numTee];
+					command->teeAppend[command->numTee] = (tok->type == TOK_GTGT);
+					command->numTee++;
+				}
+				else
+				{
+					error = "too many outputs";
+					break;
+				}
+				strcpy(target, tokens.tokens[i+1].text);
+				i++;
+				break;
+
+			// Background process, only at end of line
+			// Otherwise it's just a word, like any other unsupported operator
+			case TOK_AMP:
+				if(i == tokens.count - 1)
+					command->bgProc = 1;
+				else
+					addArg(command, args++, tok->text);
+				break;
 
-			// Change $$ to be format specifier instead
-			*pidLoc = '%';
-			*(++pidLoc) = 'd';
+			// |tee [-a] FILE..., output goes to stdout and each file
+			// Any other pipe is just a word
+			case TOK_PIPE:
+				if(i + 1 < tokens.count && tokens.tokens[i+1].type == TOK_WORD
+						&& !strcmp("tee", tokens.tokens[i+1].text))
+				{
+					command->teeStdout = 1;
+					for(i += 2; i < tokens.count && tokens.tokens[i].type == TOK_WORD && error == NULL; i++)
+					{
+						if(!strcmp("-a", tokens.tokens[i].text))
+							append = 1;
+						else if(command->numTee == MAX_TEE)
+							error = "too many outputs";
+						else if(strlen(tokens.tokens[i].text) >= WORD_SIZE)
+							error = "tee filename too long";
+						else
+						{
+							strcpy(command->teeFile[command->numTee], tokens.tokens[i].text);
+							command->teeAppend[command->numTee] = append;
+							command->numTee++;
+						}
+					}
+					i--;
+				}
+				else
+					addArg(command, args++, tok->text);
+				break;
 
-			// Reassign as component
-			snprintf(buffer, sizeof(buffer), components[i], shellPid);
-			components[i] = buffer;
+			default:
+				addArg(command, args++, tok->text);
+				break;
 		}
 	}
 
-	// Check if background process
-	if( (args > 0) && (!strcmp("&", components[args-1])) )
+	// On error, throw away everything parsed
+	if(error != NULL)
 	{
-		// Only if not in foreground mode
-		if(!fgMode)
-			command->bgProc = 1;
-
-		// Adjust number of args to match real args
-		args--;
+		for(i = 0; i < args; i++)
+			free(command->args[i]);
+		args = 0;
 	}
 
-	// Adjust number of args to match real args
-	if(command->redirStdin)
-		args = args - 2;
-	if(command->redirStdout)
-		args = args - 2;
+	// Final arg should be NULL
 	command->numArgs = args;
+	command->args[args] = NULL;
 
-	// Create array of args used in exec()
-	// Command is first arg, and last arg is NULL
-	command->args = malloc(sizeof(char *) * (args + 1));
-	if(command->args == NULL) exit(5);
+	freeTokens(&tokens);
+	return error;
+}
 
-	// Loop through and assign args
-	for(i = 0; i < args; i++)
+/*
+ * SHIFT COMMAND ARGS
+ * Frees the first count args and moves the rest to the front
+ * */
+void shiftCmd(struct Cmd * command, int count)
+{
+	int i = 0;	// Loop through
+
+	if(count > command->numArgs)
+		count = command->numArgs;
+
+	// Free args being dropped
+	for(i = 0; i < count; i++)
 	{
-		command->args[i] = malloc(sizeof(char) * WORD_SIZE);
-		if(command->args[i] == NULL) exit(5);
-		memset(command->args[i], '\0', sizeof(char) * WORD_SIZE);
-		strcpy(command->args[i], components[i]);
+		free(command->args[i]);
+		command->args[i] = NULL;
 	}
 
-	// Final arg should be NULL
-	command->args[args] = NULL;
+	// Move remaining args, including final NULL
+	for(i = count; i <= command->numArgs; i++)
+	{
+		command->args[i - count] = command->args[i];
+	}
+
+	command->numArgs -= count;
 }
 
 /*
@@ -153,5 +320,8 @@ void destroyCmd(struct Cmd * command)
 	// Free array of args itself
 	free(command->args);
 	command->args = NULL;
+
+	free(command->setEnv);
+	command->setEnv = NULL;
 }
 
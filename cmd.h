@@ -10,6 +10,8 @@
 // Header files
 #include <stdio.h>
 #include <stdlib.h>
+#include "jobSched.h"
+#include "jobLimits.h"
 
 // Constants
 #ifndef WORD_SIZE
@@ -20,6 +22,10 @@
 #define MAX_COMPONENTS 518
 #endif
 
+#ifndef MAX_TEE
+#define MAX_TEE 8
+#endif
+
 // Command Struct
 struct Cmd
 {
@@ -30,11 +36,23 @@ struct Cmd
 	int redirStdout;								// Should stdout be redirected
 	char stdinFile[WORD_SIZE];						// Filename of stdin redirect
 	char stdoutFile[WORD_SIZE];						// Filename of stdout redirect
+	int stdoutAppend;								// Redirect with >> instead of >
+	int numTee;										// Extra outputs, from more > or >> or |tee
+	char teeFile[MAX_TEE][WORD_SIZE];				// Filenames of extra outputs
+	int teeAppend[MAX_TEE];							// Append to extra output
+	int teeStdout;									// |tee, output goes to stdout too
+	int stdinFd;									// Open fd to use as stdin, or -1
+	int stdoutFd;									// Open fd to use as stdout, or -1
+	struct SchedOpts sched;							// Scheduling applied before exec
+	struct JobLimits limits;						// Resource limits applied before exec
+	char * setEnv;									// NAME=VALUE added to child's environment, or NULL
 };
 
 // Function Prototypes
 void initCmd(struct Cmd * command);					// Initialize command struct
 void parseCmd(struct Cmd * command, char * line);	// Parse line received
+const char * parseCmdQuiet(struct Cmd * command, char * line);	// Parse, returning any error
+void shiftCmd(struct Cmd * command, int count);	// Drop leading args (prefixes)
 void destroyCmd(struct Cmd * command);				// Free memory when done
 
 #endif
@@ -0,0 +1,114 @@
+/*
+ * COMMAND QUEUE IMPLEMENTATION
+ * FIFO of parsed commands waiting to be launched
+ *
+ * */
+
+// Header Files
+#include "cmdQueue.h"
+#include <stdlib.h>
+#include <stdio.h>
+
+/*
+ * INITIALIZE COMMAND QUEUE
+ * */
+void initCmdQueue(struct CmdQueue * queue)
+{
+	queue->head = NULL;
+	queue->tail = NULL;
+	queue->count = 0;
+}
+
+/*
+ * PUSH COMMAND ONTO END OF QUEUE
+ * Queue takes ownership of command's memory
+ * */
+void pushCmdQueue(struct CmdQueue * queue, struct Cmd * command)
+{
+	pushCmdQueueHook(queue, command, NULL, 0);
+}
+
+/*
+ * PUSH COMMAND, WITH FUNCTION TO CALL ONCE IT'S LAUNCHED
+ * So whoever queued it can track the process
+ * */
+void pushCmdQueueHook(struct CmdQueue * queue, struct Cmd * command, CmdLaunched launched, int tag)
+{
+	// Allocate new node
+	struct CmdNode * newNode = malloc(sizeof(struct CmdNode));
+	if(newNode == NULL) exit(20);
+	newNode->command = *command;
+	newNode->launched = launched;
+	newNode->tag = tag;
+	newNode->next = NULL;
+
+	// Add node to queue
+	if(queue->tail == NULL)
+		queue->head = newNode;
+	else
+		queue->tail->next = newNode;
+	queue->tail = newNode;
+
+	// Update count
+	queue->count++;
+}
+
+/*
+ * POP COMMAND FROM FRONT OF QUEUE
+ * Caller takes ownership of command's memory
+ * Returns 0 if queue was empty
+ * */
+int popCmdQueue(struct CmdQueue * queue, struct Cmd * command)
+{
+	CmdLaunched launched;
+	int tag;
+
+	return popCmdQueueHook(queue, command, &launched, &tag);
+}
+
+/*
+ * POP COMMAND AND ITS LAUNCH FUNCTION
+ * Caller calls launched, if set, after launching the command
+ * Returns 0 if queue was empty
+ * */
+int popCmdQueueHook(struct CmdQueue * queue, struct Cmd * command, CmdLaunched * launched, int * tag)
+{
+	struct CmdNode * temp = queue->head;
+
+	if(temp == NULL)
+		return 0;
+
+	// Unlink front node
+	queue->head = temp->next;
+	if(queue->head == NULL)
+		queue->tail = NULL;
+	queue->count--;
+
+	*command = temp->command;
+	*launched = temp->launched;
+	*tag = temp->tag;
+	free(temp);
+	temp = NULL;
+
+	return 1;
+}
+
+/*
+ * GET SIZE OF QUEUE
+ * */
+int getCmdQueueSize(struct CmdQueue * queue)
+{
+	return queue->count;
+}
+
+/*
+ * FREE QUEUE MEMORY
+ * Destroys any commands still waiting
+ * */
+void freeCmdQueue(struct CmdQueue * queue)
+{
+	struct Cmd command;
+
+	while(popCmdQueue(queue, &command))
+		destroyCmd(&command);
+}
@@ -0,0 +1,48 @@
+/*
+ * COMMAND QUEUE HEADER FILE
+ * FIFO of parsed commands waiting to be launched
+ *
+ * Exit Error 20 indicates error with malloc
+ * */
+
+#ifndef CMD_QUEUE_H
+#define CMD_QUEUE_H
+
+// Header Files
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include "cmd.h"
+
+// Called with the pid once a queued command is launched
+typedef void (*CmdLaunched)(pid_t pid, int tag);
+
+/* Main Struct for Command Queue */
+struct CmdQueue
+{
+	struct CmdNode * head;
+	struct CmdNode * tail;
+	int count;
+};
+
+/* Each Node of Command Queue */
+struct CmdNode
+{
+	struct CmdNode * next;
+	struct Cmd command;
+	CmdLaunched launched;		// Or NULL
+	int tag;					// Passed to launched
+};
+
+// Queue function prototypes
+// Commands are moved in and out of the queue by value,
+// so the queue owns a command's memory while it holds it
+void initCmdQueue(struct CmdQueue * queue);
+void pushCmdQueue(struct CmdQueue * queue, struct Cmd * command);
+void pushCmdQueueHook(struct CmdQueue * queue, struct Cmd * command, CmdLaunched launched, int tag);
+int popCmdQueue(struct CmdQueue * queue, struct Cmd * command);
+int popCmdQueueHook(struct CmdQueue * queue, struct Cmd * command, CmdLaunched * launched, int * tag);
+int getCmdQueueSize(struct CmdQueue * queue);
+void freeCmdQueue(struct CmdQueue * queue);
+
+#endif
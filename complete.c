@@ -0,0 +1,498 @@
+/*
+ * COMPLETION IMPLEMENTATION FILE
+ *
+ * Tab completion of commands and filenames
+ * Commands come from a trie per $PATH directory, built the first time
+ * it's needed and rebuilt only when that directory's mtime changes
+ * */
+
+// Header files
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include "complete.h"
+
+// Nodes are allocated in blocks, so a whole trie is freed quickly
+#define TRIE_BLOCK_NODES 1024
+
+// Names deeper than this aren't collected
+#define TRIE_MAX_DEPTH 256
+
+/* Each Node of a Trie */
+// Children are a linked list, sorted by character
+struct TrieNode
+{
+	struct TrieNode * child;
+	struct TrieNode * sibling;
+	char ch;
+	char terminal;				// True if a name ends here
+};
+
+/* Block of Trie Nodes */
+struct TrieBlock
+{
+	struct TrieBlock * next;
+	int used;
+	struct TrieNode nodes[TRIE_BLOCK_NODES];
+};
+
+/* Main Struct for Trie */
+struct Trie
+{
+	struct TrieNode root;
+	struct TrieBlock * blocks;
+};
+
+/* Directory in $PATH */
+struct PathDir
+{
+	char * path;
+	int loaded;					// Has trie been built
+	struct timespec mtime;		// mtime when trie was built
+	struct Trie trie;
+};
+
+// Shell builtins, always completed
+static const char * builtinNames[] = {
+	"bgmax", "bgsched", "cd", "dag", "exit", "history", "jobs", "memo", "notify", "set", "status", "subreaper", "ulimit", "watch", NULL
+};
+
+// Tries
+static struct Trie builtinTrie;
+static int builtinsLoaded = 0;
+static struct PathDir * pathDirs = NULL;
+static int pathDirCount = 0;
+static char * pathCopy = NULL;	// $PATH the dirs were built from
+
+/******************************** TRIE FUNCTIONS *********************************************/
+
+/*
+ * INITIALIZE TRIE
+ * */
+static void initTrie(struct Trie * trie)
+{
+	memset(&trie->root, 0, sizeof(struct TrieNode));
+	trie->blocks = NULL;
+}
+
+/*
+ * ALLOCATE TRIE NODE
+ * */
+static struct TrieNode * newNode(struct Trie * trie, char ch)
+{
+	struct TrieBlock * block = trie->blocks;
+	struct TrieNode * node = NULL;
+
+	if(block == NULL || block->used == TRIE_BLOCK_NODES)
+	{
+		block = malloc(sizeof(struct TrieBlock));
+		if(block == NULL) exit(20);
+		block->used = 0;
+		block->next = trie->blocks;
+		trie->blocks = block;
+	}
+
+	node = &block->nodes[block->used++];
+	node->child = NULL;
+	node->sibling = NULL;
+	node->ch = ch;
+	node->terminal = 0;
+	return node;
+}
+
+/*
+ * INSERT NAME INTO TRIE
+ * */
+static void insertTrie(struct Trie * trie, const char * name)
+{
+	struct TrieNode * node = &trie->root;
+	struct TrieNode ** link = NULL;
+	struct TrieNode * added = NULL;
+
+	for(; *name != '\0'; name++)
+	{
+		// Find place for character in sorted children
+		link = &node->child;
+		while(*link != NULL && (*link)->ch < *name)
+			link = &(*link)->sibling;
+
+		if(*link == NULL || (*link)->ch != *name)
+		{
+			added = newNode(trie, *name);
+			added->sibling = *link;
+			*link = added;
+		}
+		node = *link;
+	}
+
+	node->terminal = 1;
+}
+
+/*
+ * ADD MATCH
+ * */
+static void addMatch(struct Matches * matches, const char * name)
+{
+	if(matches->count == matches->capacity)
+	{
+		matches->capacity = matches->capacity ? matches->capacity * 2 : 16;
+		matches->items = realloc(matches->items, sizeof(char *) * matches->capacity);
+		if(matches->items == NULL) exit(20);
+	}
+
+	matches->items[matches->count] = malloc(strlen(name) + 1);
+	if(matches->items[matches->count] == NULL) exit(20);
+	strcpy(matches->items[matches->count], name);
+	matches->count++;
+}
+
+/*
+ * COLLECT NAMES BELOW NODE
+ * name holds the characters so far, depth is its length
+ * */
+static void collectTrie(struct TrieNode * node, char * name, int depth, struct Matches * matches)
+{
+	struct TrieNode * child = NULL;
+
+	if(node->terminal)
+	{
+		name[depth] = '\0';
+		addMatch(matches, name);
+	}
+
+	if(depth + 1 >= TRIE_MAX_DEPTH)
+		return;
+
+	for(child = node->child; child != NULL; child = child->sibling)
+	{
+		name[depth] = child->ch;
+		collectTrie(child, name, depth + 1, matches);
+	}
+}
+
+/*
+ * FIND NAMES WITH PREFIX
+ * */
+static void searchTrie(struct Trie * trie, const char * prefix, struct Matches * matches)
+{
+	char name[TRIE_MAX_DEPTH];
+	struct TrieNode * node = &trie->root;
+	struct TrieNode * child = NULL;
+	int depth = 0;
+
+	// Walk down to prefix
+	for(depth = 0; prefix[depth] != '\0'; depth++)
+	{
+		if(depth + 1 >= TRIE_MAX_DEPTH)
+			return;
+
+		for(child = node->child; child != NULL && child->ch < prefix[depth]; child = child->sibling);
+		if(child == NULL || child->ch != prefix[depth])
+			return;
+
+		name[depth] = prefix[depth];
+		node = child;
+	}
+
+	collectTrie(node, name, depth, matches);
+}
+
+/*
+ * FREE TRIE MEMORY
+ * */
+static void freeTrie(struct Trie * trie)
+{
+	struct TrieBlock * block = trie->blocks;
+	struct TrieBlock * temp = NULL;
+
+	while(block != NULL)
+	{
+		temp = block;
+		block = block->next;
+		free(temp);
+	}
+	initTrie(trie);
+}
+
+/******************************** PATH FUNCTIONS *********************************************/
+
+/*
+ * FREE PATH DIRECTORIES
+ * */
+static void freePathDirs(void)
+{
+	int i = 0;
+
+	for(i = 0; i < pathDirCount; i++)
+	{
+		freeTrie(&pathDirs[i].trie);
+		free(pathDirs[i].path);
+	}
+	free(pathDirs);
+	free(pathCopy);
+	pathDirs = NULL;
+	pathDirCount = 0;
+	pathCopy = NULL;
+}
+
+/*
+ * SPLIT $PATH INTO DIRECTORIES
+ * Only redone if $PATH changed
+ * */
+static void loadPathDirs(void)
+{
+	char * path = getenv("PATH");
+	char * dir = NULL;
+	char * copy = NULL;
+	char * save = NULL;
+
+	if(path == NULL)
+		path = "";
+	if(pathCopy != NULL && !strcmp(pathCopy, path))
+		return;
+
+	freePathDirs();
+	pathCopy = malloc(strlen(path) + 1);
+	copy = malloc(strlen(path) + 1);
+	pathDirs = malloc(sizeof(struct PathDir) * (strlen(path) / 2 + 1));
+	if(pathCopy == NULL || copy == NULL || pathDirs == NULL) exit(20);
+	strcpy(pathCopy, path);
+	strcpy(copy, path);
+
+	for(dir = strtok_r(copy, ":", &save); dir != NULL; dir = strtok_r(NULL, ":", &save))
+	{
+		pathDirs[pathDirCount].path = malloc(strlen(dir) + 1);
+		if(pathDirs[pathDirCount].path == NULL) exit(20);
+		strcpy(pathDirs[pathDirCount].path, dir);
+		pathDirs[pathDirCount].loaded = 0;
+		initTrie(&pathDirs[pathDirCount].trie);
+		pathDirCount++;
+	}
+
+	free(copy);
+}
+
+/*
+ * REFRESH DIRECTORY TRIE
+ * Rebuilds if never built, or directory changed since
+ * */
+static void refreshPathDir(struct PathDir * dir)
+{
+	struct stat dirStat;
+	struct stat fileStat;
+	struct dirent * entry = NULL;
+	DIR * stream = NULL;
+
+	if(stat(dir->path, &dirStat) == -1)
+	{
+		freeTrie(&dir->trie);
+		dir->loaded = 0;
+		return;
+	}
+
+	if(dir->loaded && dirStat.st_mtim.tv_sec == dir->mtime.tv_sec && dirStat.st_mtim.tv_nsec == dir->mtime.tv_nsec)
+		return;
+
+	freeTrie(&dir->trie);
+	dir->loaded = 1;
+	dir->mtime = dirStat.st_mtim;
+
+	stream = opendir(dir->path);
+	if(stream == NULL)
+		return;
+
+	while((entry = readdir(stream)) != NULL)
+	{
+		if(entry->d_name[0] == '.')
+			continue;
+
+		// Only regular executable files, following symlinks
+		if(entry->d_type != DT_REG && entry->d_type != DT_LNK && entry->d_type != DT_UNKNOWN)
+			continue;
+		if(fstatat(dirfd(stream), entry->d_name, &fileStat, 0) == -1 || !S_ISREG(fileStat.st_mode))
+			continue;
+		if(!(fileStat.st_mode & (S_IXUSR | S_IXGRP | S_IXOTH)))
+			continue;
+
+		insertTrie(&dir->trie, entry->d_name);
+	}
+
+	closedir(stream);
+}
+
+/******************************** MATCH FUNCTIONS *********************************************/
+
+/*
+ * INITIALIZE MATCHES
+ * */
+void initMatches(struct Matches * matches)
+{
+	matches->items = NULL;
+	matches->count = 0;
+	matches->capacity = 0;
+}
+
+/*
+ * COMPARE NAMES FOR QSORT
+ * */
+static int compareNames(const void * a, const void * b)
+{
+	return strcmp(*(char * const *)a, *(char * const *)b);
+}
+
+/*
+ * SORT MATCHES AND DROP DUPLICATES
+ * */
+static void sortMatches(struct Matches * matches)
+{
+	int i = 0;
+	int kept = 0;
+
+	qsort(matches->items, matches->count, sizeof(char *), compareNames);
+
+	for(i = 0; i < matches->count; i++)
+	{
+		if(kept > 0 && !strcmp(matches->items[kept - 1], matches->items[i]))
+			free(matches->items[i]);
+		else
+			matches->items[kept++] = matches->items[i];
+	}
+	matches->count = kept;
+}
+
+/*
+ * COMPLETE COMMAND NAME
+ * */
+void completeCommand(const char * prefix, struct Matches * matches)
+{
+	int i = 0;
+
+	if(!builtinsLoaded)
+	{
+		initTrie(&builtinTrie);
+		for(i = 0; builtinNames[i] != NULL; i++)
+			insertTrie(&builtinTrie, builtinNames[i]);
+		builtinsLoaded = 1;
+	}
+	searchTrie(&builtinTrie, prefix, matches);
+
+	loadPathDirs();
+	for(i = 0; i < pathDirCount; i++)
+	{
+		refreshPathDir(&pathDirs[i]);
+		searchTrie(&pathDirs[i].trie, prefix, matches);
+	}
+
+	sortMatches(matches);
+}
+
+/*
+ * COMPLETE FILENAME
+ * Prefix may include a directory, matches include it too
+ * */
+void completeFile(const char * prefix, struct Matches * matches)
+{
+	char dirPath[4096];
+	char name[4096 + 256];
+	const char * base = strrchr(prefix, '/');
+	size_t dirLen = 0;
+	size_t baseLen = 0;
+	struct dirent * entry = NULL;
+	struct stat fileStat;
+	DIR * stream = NULL;
+	int isDir = 0;
+
+	// Split directory and name parts
+	if(base == NULL)
+	{
+		strcpy(dirPath, ".");
+		base = prefix;
+	}
+	else
+	{
+		dirLen = base - prefix + 1;
+		if(dirLen >= sizeof(dirPath))
+			return;
+		memcpy(dirPath, prefix, dirLen);
+		dirPath[dirLen] = '\0';
+		base++;
+	}
+	baseLen = strlen(base);
+
+	stream = opendir(dirPath);
+	if(stream == NULL)
+		return;
+
+	while((entry = readdir(stream)) != NULL)
+	{
+		// Hidden files only if asked for
+		if(entry->d_name[0] == '.' && base[0] != '.')
+			continue;
+		if(!strcmp(".", entry->d_name) || !strcmp("..", entry->d_name))
+			continue;
+		if(strncmp(base, entry->d_name, baseLen))
+			continue;
+
+		if(entry->d_type == DT_DIR)
+			isDir = 1;
+		else if(entry->d_type == DT_LNK || entry->d_type == DT_UNKNOWN)
+			isDir = (fstatat(dirfd(stream), entry->d_name, &fileStat, 0) == 0 && S_ISDIR(fileStat.st_mode));
+		else
+			isDir = 0;
+
+		snprintf(name, sizeof(name), "%.*s%s%s", (int)dirLen, prefix, entry->d_name, isDir ? "/" : "");
+		addMatch(matches, name);
+	}
+
+	closedir(stream);
+	sortMatches(matches);
+}
+
+/*
+ * LENGTH OF PREFIX SHARED BY ALL MATCHES
+ * Matches are sorted, so only first and last need comparing
+ * */
+int commonPrefixLen(struct Matches * matches)
+{
+	int len = 0;
+	char * first = NULL;
+	char * last = NULL;
+
+	if(matches->count == 0)
+		return 0;
+
+	first = matches->items[0];
+	last = matches->items[matches->count - 1];
+	while(first[len] != '\0' && first[len] == last[len])
+		len++;
+
+	return len;
+}
+
+/*
+ * FREE MATCHES
+ * */
+void freeMatches(struct Matches * matches)
+{
+	int i = 0;
+
+	for(i = 0; i < matches->count; i++)
+		free(matches->items[i]);
+	free(matches->items);
+	initMatches(matches);
+}
+
+/*
+ * FREE ALL TRIES
+ * */
+void freeCompletion(void)
+{
+	freePathDirs();
+	if(builtinsLoaded)
+		freeTrie(&builtinTrie);
+	builtinsLoaded = 0;
+}
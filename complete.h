@@ -0,0 +1,34 @@
+/*
+ * COMPLETION HEADER FILE
+ *
+ * Tab completion of commands and filenames
+ * Commands come from a trie per $PATH directory, built the first time
+ * it's needed and rebuilt only when that directory's mtime changes
+ *
+ * Exit Error 20 indicates error with malloc
+ * */
+
+#ifndef COMPLETE_H
+#define COMPLETE_H
+
+// Header files
+#include <stdio.h>
+#include <stdlib.h>
+
+// Completion Matches Struct
+struct Matches
+{
+	char ** items;				// Names matched, sorted with no duplicates
+	int count;					// Number of names
+	int capacity;				// Space in items array
+};
+
+// Function Prototypes
+void initMatches(struct Matches * matches);
+void completeCommand(const char * prefix, struct Matches * matches);	// Builtins and $PATH executables
+void completeFile(const char * prefix, struct Matches * matches);		// Files, dirs get a trailing /
+int commonPrefixLen(struct Matches * matches);						// Length shared by all matches
+void freeMatches(struct Matches * matches);
+void freeCompletion(void);											// Free all tries
+
+#endif
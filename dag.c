@@ -0,0 +1,613 @@
+/*
+ * DAG IMPLEMENTATION FILE
+ *
+ * Dependency graph runner
+ * Reads make-like rules and runs each target's commands once all its
+ * dependencies have succeeded, up to N targets at a time, longest
+ * remaining chain first
+ *
+ * File format:
+ *     # comment
+ *     target: dep dep
+ *         command
+ *         command
+ * Commands are tab-indented and run in order, each after the last
+ * succeeds. A dependency with no rule must be an existing file.
+ *
+ * Exit Error 20 indicates error with malloc
+ * */
+
+// Header files
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <sys/signalfd.h>
+#include "dag.h"
+#include "cmd.h"
+#include "spawn.h"
+#include "eventLoop.h"
+#include "output.h"
+
+// Node states
+#define NODE_WAITING 0				// Dependencies not done
+#define NODE_READY 1				// Can be started
+#define NODE_RUNNING 2
+#define NODE_DONE 3
+#define NODE_FAILED 4
+#define NODE_SKIPPED 5				// A dependency failed
+
+// Global resource limits for all jobs
+// Comes from jobLimits.h library
+extern struct JobLimits jobLimitDefault;
+
+// One target
+struct DagNode
+{
+	char * name;
+	int hasRule;					// Defined in file, not just named as a dependency
+	char ** cmds;					// Commands to run in order
+	int numCmds;
+	int * deps;						// Indexes of nodes this depends on
+	int numDeps;
+	int * users;					// Indexes of nodes depending on this
+	int numUsers;
+	int waiting;					// Dependencies not yet done
+	long priority;					// Commands on longest chain from here
+	int state;
+	int curCmd;						// Command running
+	pid_t pid;
+	int exitMethod;					// Of failing command
+	struct timespec start;
+	struct timespec end;
+};
+
+// Whole graph
+struct Dag
+{
+	struct DagNode * nodes;
+	int count;
+	int cap;
+	int running;					// Nodes running now
+	int maxJobs;					// Nodes allowed to run at once
+	struct timespec start;
+};
+
+/*
+ * APPEND TO ARRAY, GROWING IT
+ * */
+static void * grow(void * array, int count, size_t size)
+{
+	// Capacity doubles at each power of 2
+	if(count == 0 || (count & (count - 1)) == 0)
+	{
+		array = realloc(array, (count ? count * 2 : 4) * size);
+		if(array == NULL) exit(20);
+	}
+
+	return array;
+}
+
+/*
+ * FIND NODE BY NAME, ADDING IT IF NEW
+ * */
+static int findNode(struct Dag * dag, char * name)
+{
+	struct DagNode * node = NULL;
+	int i;
+
+	for(i = 0; i < dag->count; i++)
+	{
+		if(!strcmp(dag->nodes[i].name, name))
+			return i;
+	}
+
+	if(dag->count == dag->cap)
+	{
+		dag->cap = dag->cap ? dag->cap * 2 : 16;
+		dag->nodes = realloc(dag->nodes, dag->cap * sizeof(struct DagNode));
+		if(dag->nodes == NULL) exit(20);
+	}
+
+	node = &dag->nodes[dag->count];
+	memset(node, 0, sizeof(struct DagNode));
+	node->name = strdup(name);
+	if(node->name == NULL) exit(20);
+
+	return dag->count++;
+}
+
+/*
+ * ADD DEPENDENCY EDGE
+ * */
+static void addDep(struct Dag * dag, int node, int dep)
+{
+	struct DagNode * target = &dag->nodes[node];
+	struct DagNode * source = &dag->nodes[dep];
+
+	target->deps = grow(target->deps, target->numDeps, sizeof(int));
+	target->deps[target->numDeps++] = dep;
+	source->users = grow(source->users, source->numUsers, sizeof(int));
+	source->users[source->numUsers++] = node;
+}
+
+/*
+ * READ RULES FROM FILE
+ * Returns -1 on a syntax error
+ * */
+static int readDag(struct Dag * dag, FILE * file, char * path)
+{
+	char * line = NULL;
+	size_t size = 0;
+	ssize_t len = 0;
+	char * colon = NULL;
+	char * word = NULL;
+	char * save = NULL;
+	int lineNum = 0;
+	int cur = -1;				// Rule commands are added to
+	struct DagNode * node = NULL;
+	int result = 0;
+
+	while(result == 0 && (len = getline(&line, &size, file)) != -1)
+	{
+		lineNum++;
+		if(len > 0 && line[len - 1] == '\n')
+			line[--len] = '\0';
+
+		// Command for current rule
+		if(line[0] == '\t')
+		{
+			if(cur == -1)
+			{
+				outPrintf("dag: %s:%d: command before first target\n", path, lineNum);
+				result = -1;
+				continue;
+			}
+			for(word = line; *word == '\t' || *word == ' '; word++);
+			if(*word == '\0' || *word == '#')
+				continue;
+
+			node = &dag->nodes[cur];
+			node->cmds = grow(node->cmds, node->numCmds, sizeof(char *));
+			node->cmds[node->numCmds] = strdup(word);
+			if(node->cmds[node->numCmds] == NULL) exit(20);
+			node->numCmds++;
+			continue;
+		}
+
+		// Blank line or comment
+		for(word = line; *word == ' '; word++);
+		if(*word == '\0' || *word == '#')
+			continue;
+
+		// target: deps
+		colon = strchr(line, ':');
+		if(colon != NULL)
+			*colon = '\0';
+		word = strtok_r(line, " \t", &save);
+		if(colon == NULL || word == NULL || strtok_r(NULL, " \t", &save) != NULL)
+		{
+			outPrintf("dag: %s:%d: expected 'target: deps'\n", path, lineNum);
+			result = -1;
+			continue;
+		}
+
+		cur = findNode(dag, word);
+		if(dag->nodes[cur].hasRule)
+		{
+			outPrintf("dag: %s:%d: target %s defined twice\n", path, lineNum, word);
+			result = -1;
+			continue;
+		}
+		dag->nodes[cur].hasRule = 1;
+
+		for(word = strtok_r(colon + 1, " \t", &save); word != NULL; word = strtok_r(NULL, " \t", &save))
+			addDep(dag, cur, findNode(dag, word));
+	}
+
+	free(line);
+	return result;
+}
+
+/*
+ * CHECK GRAPH AND SET PRIORITIES
+ * Dependencies with no rule must be files, and there can't be cycles
+ * Priority is the number of commands on the longest chain from a node
+ * to the end, so the critical path starts first
+ * Returns -1 if graph can't be run
+ * */
+static int planDag(struct Dag * dag)
+{
+	int * order = malloc((dag->count + 1) * sizeof(int));
+	int head = 0, tail = 0;
+	int i, j;
+	struct DagNode * node = NULL;
+	long best;
+
+	if(order == NULL) exit(20);
+
+	// Kahn's algorithm, nodes with no dependencies first
+	for(i = 0; i < dag->count; i++)
+	{
+		node = &dag->nodes[i];
+		if(!node->hasRule && access(node->name, F_OK) == -1)
+		{
+			outPrintf("dag: no rule for %s\n", node->name);
+			free(order);
+			return -1;
+		}
+
+		node->waiting = node->numDeps;
+		if(node->waiting == 0)
+			order[tail++] = i;
+	}
+
+	while(head < tail)
+	{
+		node = &dag->nodes[order[head++]];
+		for(j = 0; j < node->numUsers; j++)
+		{
+			if(--dag->nodes[node->users[j]].waiting == 0)
+				order[tail++] = node->users[j];
+		}
+	}
+
+	if(tail < dag->count)
+	{
+		outPrintf("dag: dependency cycle\n");
+		free(order);
+		return -1;
+	}
+
+	// Longest chain, working back from the ends
+	for(i = dag->count - 1; i >= 0; i--)
+	{
+		node = &dag->nodes[order[i]];
+		best = 0;
+		for(j = 0; j < node->numUsers; j++)
+		{
+			if(dag->nodes[node->users[j]].priority > best)
+				best = dag->nodes[node->users[j]].priority;
+		}
+		node->priority = best + node->numCmds;
+	}
+
+	// Reset for running
+	for(i = 0; i < dag->count; i++)
+	{
+		node = &dag->nodes[i];
+		node->waiting = node->numDeps;
+		node->state = (node->waiting == 0) ? NODE_READY : NODE_WAITING;
+	}
+
+	free(order);
+	return 0;
+}
+
+/*
+ * MILLISECONDS BETWEEN TIMES
+ * */
+static long elapsedMs(struct timespec * from, struct timespec * to)
+{
+	return (to->tv_sec - from->tv_sec) * 1000 + (to->tv_nsec - from->tv_nsec) / 1000000;
+}
+
+/*
+ * SKIP EVERYTHING DEPENDING ON NODE
+ * */
+static void skipUsers(struct Dag * dag, struct DagNode * node)
+{
+	struct DagNode * user = NULL;
+	int i;
+
+	for(i = 0; i < node->numUsers; i++)
+	{
+		user = &dag->nodes[node->users[i]];
+		if(user->state == NODE_SKIPPED)
+			continue;
+
+		user->state = NODE_SKIPPED;
+		skipUsers(dag, user);
+	}
+}
+
+/*
+ * START NODE'S CURRENT COMMAND
+ * Blank commands are passed over
+ * Returns 0 if a process was started, 1 if no commands are left,
+ * or -1 on a bad command or if it couldn't be started
+ * */
+static int spawnNext(struct DagNode * node)
+{
+	struct Cmd command;
+
+	for(; node->curCmd < node->numCmds; node->curCmd++)
+	{
+		initCmd(&command);
+		parseCmd(&command, node->cmds[node->curCmd]);
+
+		if(command.args[0] == NULL)
+		{
+			destroyCmd(&command);
+			continue;
+		}
+
+		if(ss_prefixes(&command) == -1)
+		{
+			destroyCmd(&command);
+			node->exitMethod = 1 << 8;
+			return -1;
+		}
+
+		// Jobs wait for each other, so a trailing & means nothing
+		command.bgProc = 0;
+		mergeLimits(&command.limits, &jobLimitDefault);
+
+		outPrintf("dag: %s: %s\n", node->name, node->cmds[node->curCmd]);
+		node->pid = ss_spawn(&command);
+		destroyCmd(&command);
+		if(node->pid == -1)
+		{
+			outPrintf("dag: %s: cannot fork: %s\n", node->name, strerror(errno));
+			node->pid = 0;
+			node->exitMethod = 1 << 8;
+			return -1;
+		}
+		return 0;
+	}
+
+	return 1;
+}
+
+/*
+ * FINISH NODE
+ * */
+static void finishNode(struct Dag * dag, struct DagNode * node, int ok)
+{
+	struct DagNode * user = NULL;
+	int i;
+
+	clock_gettime(CLOCK_MONOTONIC, &node->end);
+	node->state = ok ? NODE_DONE : NODE_FAILED;
+
+	if(!ok)
+	{
+		skipUsers(dag, node);
+		return;
+	}
+
+	for(i = 0; i < node->numUsers; i++)
+	{
+		user = &dag->nodes[node->users[i]];
+		if(--user->waiting == 0 && user->state == NODE_WAITING)
+			user->state = NODE_READY;
+	}
+}
+
+/*
+ * START READY NODES
+ * Highest priority first, while there are free workers
+ * */
+static void release(struct Dag * dag)
+{
+	struct DagNode * best = NULL;
+	struct DagNode * node = NULL;
+	int started = 0;
+	int i;
+
+	while(dag->running < dag->maxJobs)
+	{
+		best = NULL;
+		for(i = 0; i < dag->count; i++)
+		{
+			node = &dag->nodes[i];
+			if(node->state == NODE_READY && (best == NULL || node->priority > best->priority))
+				best = node;
+		}
+		if(best == NULL)
+			return;
+
+		clock_gettime(CLOCK_MONOTONIC, &best->start);
+
+		// Files and targets without commands are done right away
+		started = spawnNext(best);
+		if(started != 0)
+		{
+			finishNode(dag, best, started == 1);
+			continue;
+		}
+
+		best->state = NODE_RUNNING;
+		dag->running++;
+	}
+}
+
+/*
+ * REAP FINISHED COMMANDS
+ * Only the graph's own processes are waited on, bg jobs are left for
+ * check_bg_procs()
+ * */
+static void onChild(int fd, void * data)
+{
+	struct Dag * dag = data;
+	struct DagNode * node = NULL;
+	struct signalfd_siginfo info;
+	int exitMethod = 0;
+	int started = 0;
+	int ok = 0;
+	int i;
+
+	// Signals merge, so just drain them and check every process
+	while(read(fd, &info, sizeof(info)) == sizeof(info));
+
+	for(i = 0; i < dag->count; i++)
+	{
+		node = &dag->nodes[i];
+		if(node->state != NODE_RUNNING || waitpid(node->pid, &exitMethod, WNOHANG) <= 0)
+			continue;
+
+		node->exitMethod = exitMethod;
+		ok = WIFEXITED(exitMethod) && WEXITSTATUS(exitMethod) == 0;
+
+		// Next command of this target
+		if(ok)
+		{
+			node->curCmd++;
+			started = spawnNext(node);
+			if(started == 0)
+				continue;
+			ok = (started == 1);
+		}
+
+		dag->running--;
+		finishNode(dag, node, ok);
+	}
+
+	release(dag);
+}
+
+/*
+ * PRINT TIMING REPORT
+ * Returns 0 if every target succeeded
+ * */
+static int report(struct Dag * dag)
+{
+	struct DagNode * node = NULL;
+	struct timespec now;
+	int i, failed = 0;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	outPrintf("%-24s %-14s %10s %10s\n", "target", "result", "start ms", "time ms");
+
+	for(i = 0; i < dag->count; i++)
+	{
+		node = &dag->nodes[i];
+		if(!node->hasRule)
+			continue;
+
+		switch(node->state)
+		{
+			case NODE_DONE:
+				outPrintf("%-24s %-14s %10ld %10ld\n", node->name, "ok",
+						elapsedMs(&dag->start, &node->start), elapsedMs(&node->start, &node->end));
+				break;
+			case NODE_FAILED:
+				failed = 1;
+				outPrintf("%-24s %-7s %-6d %10ld %10ld\n", node->name,
+						WIFEXITED(node->exitMethod) ? "exit" : "signal",
+						WIFEXITED(node->exitMethod) ? WEXITSTATUS(node->exitMethod) : WTERMSIG(node->exitMethod),
+						elapsedMs(&dag->start, &node->start), elapsedMs(&node->start, &node->end));
+				break;
+			default:
+				failed = 1;
+				outPrintf("%-24s %-14s %10s %10s\n", node->name, "skipped", "-", "-");
+				break;
+		}
+	}
+
+	outPrintf("dag: %ld ms total\n", elapsedMs(&dag->start, &now));
+	return failed;
+}
+
+/*
+ * FREE GRAPH
+ * */
+static void freeDag(struct Dag * dag)
+{
+	int i, j;
+
+	for(i = 0; i < dag->count; i++)
+	{
+		for(j = 0; j < dag->nodes[i].numCmds; j++)
+			free(dag->nodes[i].cmds[j]);
+		free(dag->nodes[i].cmds);
+		free(dag->nodes[i].deps);
+		free(dag->nodes[i].users);
+		free(dag->nodes[i].name);
+	}
+	free(dag->nodes);
+}
+
+/*
+ * DAG BUILTIN
+ * dag [-j N] FILE
+ * Runs every target in FILE, N at a time (default: number of CPUs)
+ * */
+int dagBuiltin(char ** args)
+{
+	struct Dag dag = { 0 };
+	sigset_t mask, oldMask;
+	FILE * file = NULL;
+	char * end = NULL;
+	int sigFd = -1;
+	int i = 1;
+	int result = 1;
+
+	dag.maxJobs = (int)sysconf(_SC_NPROCESSORS_ONLN);
+	if(args[i] != NULL && !strcmp("-j", args[i]) && args[i + 1] != NULL)
+	{
+		dag.maxJobs = (int)strtol(args[i + 1], &end, 10);
+		if(*end != '\0' || dag.maxJobs < 1)
+		{
+			outPrintf("dag: invalid job count %s\n", args[i + 1]);
+			return 1;
+		}
+		i += 2;
+	}
+	if(dag.maxJobs < 1)
+		dag.maxJobs = 1;
+
+	if(args[i] == NULL || args[i + 1] != NULL)
+	{
+		outPrintf("usage: dag [-j N] FILE\n");
+		return 1;
+	}
+
+	file = fopen(args[i], "r");
+	if(file == NULL)
+	{
+		outPrintf("dag: cannot open %s\n", args[i]);
+		return 1;
+	}
+	result = readDag(&dag, file, args[i]);
+	fclose(file);
+
+	if(result == 0)
+		result = planDag(&dag);
+	if(result == -1)
+	{
+		freeDag(&dag);
+		return 1;
+	}
+
+	// Reap through a signalfd in the event loop
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGCHLD);
+	sigprocmask(SIG_BLOCK, &mask, &oldMask);
+	sigFd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+	if(sigFd == -1)
+	{
+		outPrintf("dag: cannot watch for child processes\n");
+		sigprocmask(SIG_SETMASK, &oldMask, NULL);
+		freeDag(&dag);
+		return 1;
+	}
+	evAdd(sigFd, onChild, &dag);
+
+	clock_gettime(CLOCK_MONOTONIC, &dag.start);
+	release(&dag);
+	while(dag.running > 0)
+		evRunOnce(-1);
+
+	evRemove(sigFd);
+	close(sigFd);
+	sigprocmask(SIG_SETMASK, &oldMask, NULL);
+
+	result = report(&dag);
+	freeDag(&dag);
+	return result;
+}
@@ -0,0 +1,22 @@
+/*
+ * DAG HEADER FILE
+ *
+ * Dependency graph runner
+ * Reads make-like rules and runs each target's commands once all its
+ * dependencies have succeeded, up to N targets at a time, longest
+ * remaining chain first
+ *
+ * Exit Error 20 indicates error with malloc
+ * */
+
+#ifndef DAG_H
+#define DAG_H
+
+// Header files
+#include <stdio.h>
+#include <stdlib.h>
+
+// Function prototypes
+int dagBuiltin(char ** args);				// dag [-j N] FILE, returns 0 if every target succeeded
+
+#endif
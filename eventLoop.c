@@ -0,0 +1,248 @@
+/*
+ * EVENT LOOP IMPLEMENTATION FILE
+ *
+ * poll() based dispatch of readable file descriptors to callbacks
+ * */
+
+// Needed for pipe2()
+#define _GNU_SOURCE
+
+// Header files
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "eventLoop.h"
+
+/* Each Watched Fd */
+struct EventWatch
+{
+	EventFunc func;
+	void * data;
+};
+
+// Watched fds, pollFds and watches share indexes
+static struct pollfd * pollFds = NULL;
+static struct EventWatch * watches = NULL;
+static int watchCount = 0;
+static int watchCapacity = 0;
+
+// Self pipe, so signals wake a wait even if they land just before poll()
+static int wakePipe[2] = { -1, -1 };
+static volatile int woken = 0;
+
+/*
+ * ADD WATCH
+ * */
+static void addWatch(int fd, short events, EventFunc func, void * data)
+{
+	// Replace existing watch on same fd
+	evRemove(fd);
+
+	if(watchCount == watchCapacity)
+	{
+		watchCapacity = watchCapacity ? watchCapacity * 2 : 16;
+		pollFds = realloc(pollFds, sizeof(struct pollfd) * watchCapacity);
+		watches = realloc(watches, sizeof(struct EventWatch) * watchCapacity);
+		if(pollFds == NULL || watches == NULL) exit(20);
+	}
+
+	pollFds[watchCount].fd = fd;
+	pollFds[watchCount].events = events;
+	pollFds[watchCount].revents = 0;
+	watches[watchCount].func = func;
+	watches[watchCount].data = data;
+	watchCount++;
+}
+
+/*
+ * WATCH FD FOR READING
+ * Hangups and errors are reported as readable too
+ * */
+void evAdd(int fd, EventFunc func, void * data)
+{
+	addWatch(fd, POLLIN, func, data);
+}
+
+/*
+ * WATCH FD FOR WRITING
+ * */
+void evAddWrite(int fd, EventFunc func, void * data)
+{
+	addWatch(fd, POLLOUT, func, data);
+}
+
+/*
+ * STOP WATCHING FD
+ * Safe to call from a callback
+ * */
+void evRemove(int fd)
+{
+	int i = 0;
+
+	for(i = 0; i < watchCount; i++)
+	{
+		if(pollFds[i].fd == fd)
+		{
+			// Move last watch into this slot
+			watchCount--;
+			pollFds[i] = pollFds[watchCount];
+			watches[i] = watches[watchCount];
+			return;
+		}
+	}
+}
+
+/*
+ * NUMBER OF FDS WATCHED
+ * The wake pipe isn't counted
+ * */
+int evCount(void)
+{
+	return (wakePipe[0] != -1) ? watchCount - 1 : watchCount;
+}
+
+/*
+ * EMPTY WAKE PIPE
+ * */
+static void onWake(int fd, void * data)
+{
+	char buffer[64];
+
+	(void)data;
+	while(read(fd, buffer, sizeof(buffer)) > 0);
+	woken = 1;
+}
+
+/*
+ * WAIT AND DISPATCH ONCE
+ * Returns number of callbacks made, 0 on timeout, or -1 if interrupted
+ * or woken
+ * */
+int evRunOnce(int timeoutMs)
+{
+	struct EventWatch watch;
+	int ready = 0;
+	int called = 0;
+	int fd = -1;
+	int i = 0;
+
+	ready = poll(pollFds, watchCount, timeoutMs);
+	// Signal got here first, its wake byte is stale
+	if(ready == -1 && errno == EINTR && wakePipe[0] != -1)
+	{
+		onWake(wakePipe[0], NULL);
+		woken = 0;
+		errno = EINTR;
+	}
+	if(ready <= 0)
+		return ready;
+
+	// Callbacks may add or remove watches, so look each fd up again
+	for(i = 0; i < watchCount; i++)
+	{
+		if(pollFds[i].revents == 0)
+			continue;
+
+		fd = pollFds[i].fd;
+		watch = watches[i];
+		pollFds[i].revents = 0;
+		watch.func(fd, watch.data);
+		called++;
+
+		// Slot now holds a different watch, check it too
+		if(i < watchCount && pollFds[i].fd != fd)
+			i--;
+	}
+
+	// Woken up, same as being interrupted
+	if(woken)
+	{
+		woken = 0;
+		errno = EINTR;
+		return -1;
+	}
+
+	return called;
+}
+
+/*
+ * SET UP WAKE PIPE
+ * */
+void evInit(void)
+{
+	if(wakePipe[0] != -1 || pipe2(wakePipe, O_NONBLOCK | O_CLOEXEC) == -1)
+		return;
+
+	evAdd(wakePipe[0], onWake, NULL);
+}
+
+/*
+ * WAKE A WAIT
+ * Safe to call from a signal handler or another thread
+ * The wait returns -1, as if it was interrupted
+ * */
+void evWake(void)
+{
+	int savedErrno = errno;
+	ssize_t wrote = 0;
+
+	// Full pipe means a wake is already waiting
+	if(wakePipe[1] != -1)
+		wrote = write(wakePipe[1], "", 1);
+	(void)wrote;
+	errno = savedErrno;
+}
+
+/*
+ * FREE MEMORY
+ * */
+void evFree(void)
+{
+	if(wakePipe[0] != -1)
+	{
+		close(wakePipe[0]);
+		close(wakePipe[1]);
+		wakePipe[0] = wakePipe[1] = -1;
+	}
+
+	free(pollFds);
+	free(watches);
+	pollFds = NULL;
+	watches = NULL;
+	watchCount = 0;
+	watchCapacity = 0;
+}
+
+/*
+ * MARK FD READY
+ * */
+static void markReady(int fd, void * data)
+{
+	(void)fd;
+	*(int *)data = 1;
+}
+
+/*
+ * WAIT FOR FD TO BE READABLE
+ * Other watches keep being dispatched in the meantime
+ * Returns 0 when readable, or -1 if interrupted
+ * */
+int evWaitReadable(int fd)
+{
+	int ready = 0;
+	int result = 0;
+
+	if(watchCount == 0)
+		return 0;
+
+	evAdd(fd, markReady, &ready);
+	while(!ready && result != -1)
+		result = evRunOnce(-1);
+	evRemove(fd);
+
+	return ready ? 0 : -1;
+}
@@ -0,0 +1,30 @@
+/*
+ * EVENT LOOP HEADER FILE
+ *
+ * poll() based dispatch of readable file descriptors to callbacks
+ *
+ * Exit Error 20 indicates error with malloc
+ * */
+
+#ifndef EVENT_LOOP_H
+#define EVENT_LOOP_H
+
+// Header files
+#include <stdio.h>
+#include <stdlib.h>
+
+// Callback for a ready fd
+typedef void (*EventFunc)(int fd, void * data);
+
+// Function prototypes
+void evInit(void);										// Set up wake pipe
+void evWake(void);										// Make current or next wait return -1
+void evAdd(int fd, EventFunc func, void * data);		// Call func when fd is readable
+void evAddWrite(int fd, EventFunc func, void * data);	// Call func when fd is writable
+void evRemove(int fd);									// Stop watching fd
+int evCount(void);										// Number of fds watched, besides wake pipe
+int evRunOnce(int timeoutMs);							// Wait and dispatch once, -1 timeout waits forever
+int evWaitReadable(int fd);								// Dispatch others until fd is readable
+void evFree(void);										// Free memory when done
+
+#endif
@@ -0,0 +1,654 @@
+/*
+ * FANOUT IMPLEMENTATION FILE
+ *
+ * Zero-copy output handling
+ * A command with several outputs ("> a >> b", "|tee f") writes into a
+ * pipe, and the shell duplicates the pipe's pages to each output with
+ * tee() and splice() from the event loop. The cat builtin copies files
+ * in the kernel the same way.
+ *
+ * Exit Error 20 indicates error with malloc
+ * */
+
+// Needed for tee(), splice() and copy_file_range()
+#define _GNU_SOURCE
+
+// Header files
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <sys/sendfile.h>
+#include <sys/syscall.h>
+#include "fanout.h"
+#include "eventLoop.h"
+#include "output.h"
+
+// Most outputs a command can have: stdout, the > file and the extras
+#define FAN_MAX_OUTS (MAX_TEE + 2)
+
+// Bytes copied between checks for ^C
+#define COPY_CHUNK (1 << 20)
+
+// Set when SIGINT arrives, stops a copy
+// Comes from sigHandlers.c
+extern volatile sig_atomic_t sigintSignaled;
+
+// One output
+struct FanOut
+{
+	int fd;
+	int owned;					// Opened by us, so close when done
+	int canSplice;				// Cleared when splice() isn't supported
+};
+
+// One command being forwarded
+struct Fanout
+{
+	pid_t pid;					// Command writing into it, 0 until forked
+	int src;					// Read end of command's stdout
+	int srcWrite;				// Write end, closed once forked
+	int aux;					// tee() copies go through here to each output
+	int auxWrite;
+	struct FanOut outs[FAN_MAX_OUTS];
+	int numOuts;
+	struct Fanout * next;
+};
+
+// Commands being forwarded
+static struct Fanout * fans = NULL;
+
+// Set up by fanoutOpen(), waiting for fanoutAttach()
+static struct Fanout * pending = NULL;
+
+// Bytes already sent to every output are dropped from the source here
+static int nullFd = -1;
+
+/*
+ * OPEN REDIRECT TARGET
+ * A FIFO blocks until a reader shows up, so a job notice can interrupt
+ * the open, only SIGINT gives up on it
+ * */
+int openOutput(const char * file, int append)
+{
+	int fd;
+
+	while((fd = open(file, O_WRONLY | O_CREAT | O_CLOEXEC | (append ? O_APPEND : O_TRUNC), 0644)) == -1
+			&& errno == EINTR && !sigintSignaled);
+
+	return fd;
+}
+
+/*
+ * OPEN COMMAND'S OUTPUTS
+ * Output order is the > file, the extra files, then stdout for |tee
+ * Returns number opened, printing a message and setting failed for
+ * any that can't be
+ * */
+static int openOutputs(struct Cmd * command, struct FanOut * outs, int * failed)
+{
+	int count = 0;
+	int i;
+	int fd;
+
+	if(command->redirStdout)
+	{
+		fd = openOutput(command->stdoutFile, command->stdoutAppend);
+		if(fd == -1)
+		{
+			outPrintf("cannot open %s for output\n", command->stdoutFile);
+			*failed = 1;
+		}
+		else
+			outs[count++] = (struct FanOut){ fd, 1, 1 };
+	}
+
+	for(i = 0; i < command->numTee; i++)
+	{
+		fd = openOutput(command->teeFile[i], command->teeAppend[i]);
+		if(fd == -1)
+		{
+			outPrintf("cannot open %s for output\n", command->teeFile[i]);
+			*failed = 1;
+		}
+		else
+			outs[count++] = (struct FanOut){ fd, 1, 1 };
+	}
+
+	// Background jobs don't get the terminal
+	if(!command->redirStdout && !command->bgProc && (command->teeStdout || command->numTee == 0))
+	{
+		if(command->stdoutFd != -1)
+			outs[count++] = (struct FanOut){ command->stdoutFd, 0, 1 };
+		else
+			outs[count++] = (struct FanOut){ STDOUT_FILENO, 0, 1 };
+	}
+
+	return count;
+}
+
+/*
+ * CLOSE OUTPUTS
+ * */
+static void closeOutputs(struct FanOut * outs, int count)
+{
+	int i;
+
+	for(i = 0; i < count; i++)
+	{
+		if(outs[i].owned && outs[i].fd != -1)
+			close(outs[i].fd);
+	}
+}
+
+/*
+ * DOES COMMAND HAVE MORE THAN ONE OUTPUT
+ * */
+int needsFanout(struct Cmd * command)
+{
+	return command->teeStdout || command->numTee > 0;
+}
+
+/*
+ * OPEN FAN-OUT FOR COMMAND
+ * Called before fork(), the child's stdout becomes the pipe
+ * Returns -1 if the pipes can't be made
+ * */
+int fanoutOpen(struct Cmd * command)
+{
+	struct Fanout * fan = NULL;
+	int srcPipe[2], auxPipe[2];
+	int failed = 0;
+
+	if(nullFd == -1)
+		nullFd = open("/dev/null", O_WRONLY | O_CLOEXEC);
+
+	if(pipe2(srcPipe, O_CLOEXEC) == -1)
+		return -1;
+	if(pipe2(auxPipe, O_CLOEXEC) == -1)
+	{
+		close(srcPipe[0]);
+		close(srcPipe[1]);
+		return -1;
+	}
+
+	fan = malloc(sizeof(struct Fanout));
+	if(fan == NULL) exit(20);
+
+	fan->pid = 0;
+	fan->src = srcPipe[0];
+	fan->srcWrite = srcPipe[1];
+	fan->aux = auxPipe[0];
+	fan->auxWrite = auxPipe[1];
+	fan->numOuts = openOutputs(command, fan->outs, &failed);
+	fan->next = NULL;
+	fcntl(fan->src, F_SETFL, O_NONBLOCK);
+
+	// Child writes into the pipe instead
+	command->redirStdout = 0;
+	command->stdoutFd = fan->srcWrite;
+
+	pending = fan;
+	return 0;
+}
+
+/*
+ * THROW AWAY BYTES FROM PIPE
+ * */
+static void discard(int fd, ssize_t count)
+{
+	ssize_t got = 0;
+
+	while(count > 0)
+	{
+		got = splice(fd, NULL, nullFd, NULL, count, SPLICE_F_MOVE);
+		if(got > 0)
+			count -= got;
+		else if(got == 0 || errno != EINTR)
+			return;
+	}
+}
+
+/*
+ * WRITE WHOLE BUFFER
+ * Returns -1 on error
+ * */
+static int writeAll(int fd, char * buffer, ssize_t count)
+{
+	ssize_t got = 0;
+
+	while(count > 0)
+	{
+		got = write(fd, buffer, count);
+		if(got == -1 && errno == EINTR)
+			continue;
+		if(got <= 0)
+			return -1;
+		buffer += got;
+		count -= got;
+	}
+
+	return 0;
+}
+
+/*
+ * SEND COPIED BYTES TO ONE OUTPUT
+ * splice() where the output supports it, otherwise through a buffer
+ * An output that fails is dropped, the bytes are still cleared
+ * */
+static void drainAux(struct Fanout * fan, struct FanOut * out, ssize_t count)
+{
+	char buffer[8192];
+	ssize_t got = 0;
+
+	while(count > 0)
+	{
+		if(out->fd == -1)
+		{
+			discard(fan->aux, count);
+			return;
+		}
+
+		if(out->canSplice)
+		{
+			got = splice(fan->aux, NULL, out->fd, NULL, count, SPLICE_F_MOVE);
+			if(got == -1 && errno == EINVAL)
+			{
+				out->canSplice = 0;
+				continue;
+			}
+		}
+		else
+		{
+			got = read(fan->aux, buffer, count < (ssize_t)sizeof(buffer) ? count : (ssize_t)sizeof(buffer));
+			if(got > 0 && writeAll(out->fd, buffer, got) == -1)
+				got = -1;
+		}
+
+		if(got == -1 && errno == EINTR)
+			continue;
+
+		// Output gone, rest is thrown away
+		if(got <= 0)
+		{
+			if(out->owned)
+				close(out->fd);
+			out->fd = -1;
+			continue;
+		}
+
+		count -= got;
+	}
+}
+
+/*
+ * STOP FORWARDING
+ * */
+static void closeFan(struct Fanout * fan)
+{
+	struct Fanout ** link = &fans;
+
+	evRemove(fan->src);
+	close(fan->src);
+	close(fan->aux);
+	close(fan->auxWrite);
+	closeOutputs(fan->outs, fan->numOuts);
+
+	while(*link != fan)
+		link = &(*link)->next;
+	*link = fan->next;
+
+	free(fan);
+}
+
+/*
+ * SEND BYTES SOME OUTPUTS MISSED
+ * tee() may copy less than asked, so those outputs get the rest of the
+ * chunk read out of the source, which clears it from the source too
+ * */
+static void catchUp(struct Fanout * fan, ssize_t * sent, ssize_t count)
+{
+	char buffer[8192];
+	ssize_t offset = 0;
+	ssize_t got = 0;
+	ssize_t from = 0;
+	struct FanOut * out = NULL;
+	int i;
+
+	while(offset < count)
+	{
+		got = read(fan->src, buffer, count - offset < (ssize_t)sizeof(buffer) ? count - offset : (ssize_t)sizeof(buffer));
+		if(got == -1 && errno == EINTR)
+			continue;
+		if(got <= 0)
+			return;
+
+		for(i = 0; i < fan->numOuts; i++)
+		{
+			out = &fan->outs[i];
+			if(out->fd == -1 || sent[i] >= offset + got)
+				continue;
+
+			// Output that fails is dropped, like in drainAux()
+			from = sent[i] > offset ? sent[i] - offset : 0;
+			if(writeAll(out->fd, buffer + from, got - from) == -1)
+			{
+				if(out->owned)
+					close(out->fd);
+				out->fd = -1;
+			}
+		}
+
+		offset += got;
+	}
+}
+
+/*
+ * FORWARD DATA IN PIPE
+ * Event loop callback
+ * Each output gets its own tee() of the same bytes, which only adds
+ * page references, then the bytes are spliced out of the source
+ * */
+static void pump(int fd, void * data)
+{
+	struct Fanout * fan = data;
+	ssize_t sent[FAN_MAX_OUTS];
+	ssize_t count = 0;
+	ssize_t got = 0;
+	int missed = 0;
+	int i;
+
+	(void)fd;
+
+	count = tee(fan->src, fan->auxWrite, FAN_CHUNK, SPLICE_F_NONBLOCK);
+	if(count == -1 && (errno == EAGAIN || errno == EINTR))
+		return;
+
+	// Command is done with its stdout
+	if(count <= 0)
+	{
+		closeFan(fan);
+		return;
+	}
+
+	for(i = 0; i < fan->numOuts; i++)
+	{
+		// Aux pipe is empty again, so the same bytes normally fit
+		got = count;
+		if(i > 0)
+		{
+			while((got = tee(fan->src, fan->auxWrite, count, 0)) == -1 && errno == EINTR);
+			if(got < 0)
+				got = 0;
+		}
+		if(got > 0)
+			drainAux(fan, &fan->outs[i], got);
+
+		sent[i] = got;
+		if(got < count)
+			missed = 1;
+	}
+
+	// With no outputs, the first tee() still needs clearing
+	if(fan->numOuts == 0)
+		discard(fan->aux, count);
+
+	// Every output has these bytes now
+	if(missed)
+		catchUp(fan, sent, count);
+	else
+		discard(fan->src, count);
+}
+
+/*
+ * START FORWARDING
+ * Called in the parent after fork(), with -1 if it failed
+ * */
+void fanoutAttach(pid_t pid)
+{
+	struct Fanout * fan = pending;
+
+	if(fan == NULL)
+		return;
+	pending = NULL;
+
+	// Fork failed, nothing will ever write
+	if(pid == -1)
+	{
+		close(fan->srcWrite);
+		close(fan->src);
+		close(fan->aux);
+		close(fan->auxWrite);
+		closeOutputs(fan->outs, fan->numOuts);
+		free(fan);
+		return;
+	}
+
+	// Only the child writes, so we see end of file when it's done
+	close(fan->srcWrite);
+
+	fan->pid = pid;
+	fan->next = fans;
+	fans = fan;
+	evAdd(fan->src, pump, fan);
+}
+
+/*
+ * MARK PROCESS EXITED
+ * Event loop callback for a pidfd
+ * */
+static void onExit(int fd, void * data)
+{
+	evRemove(fd);
+	*(int *)data = 1;
+}
+
+/*
+ * IS PROCESS'S OUTPUT STILL BEING FORWARDED
+ * */
+static int forwarding(pid_t pid)
+{
+	struct Fanout * fan = NULL;
+
+	for(fan = fans; fan != NULL; fan = fan->next)
+	{
+		if(fan->pid == pid)
+			return 1;
+	}
+
+	return 0;
+}
+
+/*
+ * FORWARD OUTPUT WHILE WAITING FOR PROCESS
+ * Runs the event loop until the process exits and its own output is
+ * forwarded, so other jobs' output and file watches keep moving too
+ * Returns right away if the event loop has nothing to do
+ * */
+void fanoutWait(pid_t pid)
+{
+	int pidFd = -1;
+	int exited = 1;
+
+	if(fans == NULL && evCount() == 0)
+		return;
+
+	// Process exit shows up as a readable pidfd
+#ifdef SYS_pidfd_open
+	pidFd = syscall(SYS_pidfd_open, pid, 0);
+#endif
+	if(pidFd != -1)
+	{
+		exited = 0;
+		evAdd(pidFd, onExit, &exited);
+	}
+
+	while(!exited || forwarding(pid))
+		evRunOnce(-1);
+
+	if(pidFd != -1)
+		close(pidFd);
+}
+
+/*
+ * HAS ^C STOPPED THE COPY
+ * Sets errno to EINTR if so
+ * */
+static int interrupted(void)
+{
+	if(!sigintSignaled)
+		return 0;
+
+	errno = EINTR;
+	return 1;
+}
+
+/*
+ * COPY REST OF FILE TO FD
+ * copy_file_range() between files, sendfile() into pipes and sockets,
+ * and plain read()/write() for anything else
+ * Copies a chunk at a time and stops if SIGINT arrives
+ * Other signals (job notices) just restart the call
+ * Returns -1 on error, with errno EINTR if interrupted
+ * */
+int copyFd(int in, int out)
+{
+	char buffer[8192];
+	ssize_t got = 0;
+	ssize_t done = 0;
+	ssize_t wrote = 0;
+
+	do
+		got = copy_file_range(in, NULL, out, NULL, COPY_CHUNK, 0);
+	while(!sigintSignaled && (got > 0 || (got == -1 && errno == EINTR)));
+	if(interrupted())
+		return -1;
+	if(got == 0)
+		return 0;
+	if(errno != EXDEV && errno != EINVAL && errno != ENOSYS && errno != EBADF && errno != EOPNOTSUPP)
+		return -1;
+
+	do
+		got = sendfile(out, in, NULL, COPY_CHUNK);
+	while(!sigintSignaled && (got > 0 || (got == -1 && errno == EINTR)));
+	if(interrupted())
+		return -1;
+	if(got == 0)
+		return 0;
+	if(errno != EINVAL && errno != ENOSYS)
+		return -1;
+
+	while(!sigintSignaled && (got = read(in, buffer, sizeof(buffer))) != 0)
+	{
+		if(got == -1)
+		{
+			if(errno == EINTR)
+				continue;
+			return -1;
+		}
+
+		// Not writeAll(), a blocked write still has to stop for SIGINT
+		for(done = 0; done < got && !sigintSignaled; done += wrote)
+		{
+			wrote = write(out, buffer + done, got - done);
+			if(wrote == -1 && errno == EINTR)
+				wrote = 0;
+			else if(wrote <= 0)
+				return -1;
+		}
+	}
+	if(interrupted())
+		return -1;
+
+	return 0;
+}
+
+/*
+ * IS FILE SAFE TO COPY IN THE SHELL
+ * Regular files only, anything else could block or never end
+ * */
+static int isRegular(const char * file)
+{
+	struct stat info;
+
+	return stat(file, &info) == 0 && S_ISREG(info.st_mode);
+}
+
+/*
+ * CAT BUILTIN
+ * cat FILE... or cat < FILE, to any outputs the command has
+ * Only regular files with no launch prefixes are copied in the shell
+ * Options, other files, errors opening them and background jobs are
+ * left to the real cat
+ * Returns wait() style exit method, or -1 to run the real cat
+ * */
+int catBuiltin(struct Cmd * command)
+{
+	struct FanOut outs[FAN_MAX_OUTS];
+	char * stdinArgs[2] = { command->stdinFile, NULL };
+	char ** files = &command->args[1];
+	int numOuts, i, o;
+	int in = -1;
+	int result = 0;
+
+	if(command->bgProc || (command->numArgs == 1 && !command->redirStdin))
+		return -1;
+
+	// nice, ionice, cpuset and ulimit need a process to apply to
+	if(command->sched.niceSet || command->sched.ioSet || command->sched.cpuSet)
+		return -1;
+	for(i = 0; i < LIMIT_COUNT; i++)
+	{
+		if(command->limits.set[i])
+			return -1;
+	}
+
+	if(command->numArgs == 1)
+		files = stdinArgs;
+	for(i = 0; files[i] != NULL; i++)
+	{
+		if(files[i][0] == '-' || !isRegular(files[i]))
+			return -1;
+	}
+
+	numOuts = openOutputs(command, outs, &result);
+
+	outFlush();
+	sigintSignaled = 0;
+	for(i = 0; files[i] != NULL && !sigintSignaled; i++)
+	{
+		in = open(files[i], O_RDONLY | O_CLOEXEC);
+		if(in == -1)
+		{
+			outPrintf("cat: %s: %s\n", files[i], strerror(errno));
+			result = 1;
+			continue;
+		}
+
+		// Each output copies the file from the start
+		for(o = 0; o < numOuts && !sigintSignaled; o++)
+		{
+			lseek(in, 0, SEEK_SET);
+			if(copyFd(in, outs[o].fd) == -1 && !sigintSignaled)
+			{
+				outPrintf("cat: %s: %s\n", files[i], strerror(errno));
+				result = 1;
+			}
+		}
+		close(in);
+	}
+
+	closeOutputs(outs, numOuts);
+
+	// ^C stops it like it would the real cat
+	if(sigintSignaled)
+	{
+		sigintSignaled = 0;
+		return SIGINT;
+	}
+	return result << 8;
+}
@@ -0,0 +1,37 @@
+/*
+ * FANOUT HEADER FILE
+ *
+ * Zero-copy output handling
+ * A command with several outputs ("> a >> b", "|tee f") writes into a
+ * pipe, and the shell duplicates the pipe's pages to each output with
+ * tee() and splice() from the event loop. The cat builtin copies files
+ * in the kernel the same way.
+ *
+ * Exit Error 20 indicates error with malloc
+ * */
+
+#ifndef FANOUT_H
+#define FANOUT_H
+
+// Header files
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "cmd.h"
+
+// Constants
+// Most bytes moved per wakeup, the default pipe size
+#ifndef FAN_CHUNK
+#define FAN_CHUNK 65536
+#endif
+
+// Function prototypes
+int needsFanout(struct Cmd * command);					// Does command have more than one output
+int fanoutOpen(struct Cmd * command);					// Open outputs and point command's stdout at pipe
+void fanoutAttach(pid_t pid);							// Start forwarding in parent after fork(), -1 drops it
+void fanoutWait(pid_t pid);								// Forward output until process exits
+int copyFd(int in, int out);							// Copy rest of file in kernel, -1 on error
+int openOutput(const char * file, int append);			// Open redirect target in the shell, -1 on error
+int catBuiltin(struct Cmd * command);					// In-shell cat, exit method or -1 if it can't be done in-shell
+
+#endif
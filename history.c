@@ -0,0 +1,747 @@
+/*
+ * HISTORY IMPLEMENTATION FILE
+ *
+ * Persistent command history
+ * Commands are appended to a log file, and the start offset of each one
+ * is appended to an index file. Both are mmap()'d, so startup doesn't
+ * read the log and entry n is found in O(1).
+ * Prefix search uses entry numbers sorted by text, built in memory the
+ * first time a big history is searched and merged with new entries as
+ * they pile up.
+ * */
+
+// Needed for memmem()
+#define _GNU_SOURCE
+
+// Header files
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include "history.h"
+#include "output.h"
+
+// File descriptors, -1 if history is disabled
+static int logFd = -1;
+static int idxFd = -1;
+
+// Current mappings
+static char * logMap = NULL;
+static size_t logMapSize = 0;
+static uint64_t * idxMap = NULL;
+static size_t idxMapSize = 0;
+
+// Number of entries mapped
+static long histCount = 0;
+
+// Set when an index write failed, so nothing more is appended to it
+// The log still grows, and the next startup indexes its tail
+static int idxBad = 0;
+
+// Entries newer than the sorted index that are searched one by one
+// before it's rebuilt
+#define HISTORY_SORT_SLACK 4096
+
+// Entry numbers sorted by text, for prefix search
+static uint32_t * sorted = NULL;
+static long sortedCount = 0;
+static uint64_t sortedLast = 0;		// Offset of last sorted entry, to spot a cleared history
+
+/*
+ * MAP FILES
+ * Remaps log and index if they changed size
+ * Other shells may append to or clear them at any time, so sizes come
+ * from fstat() on every access
+ * */
+static void mapFiles(void)
+{
+	struct stat logStat, idxStat;
+
+	if(logFd == -1)
+		return;
+
+	if(fstat(logFd, &logStat) == -1 || fstat(idxFd, &idxStat) == -1)
+	{
+		histCount = 0;
+		return;
+	}
+
+	// Log
+	if((size_t)logStat.st_size != logMapSize)
+	{
+		if(logMap != NULL)
+			munmap(logMap, logMapSize);
+		logMap = NULL;
+		logMapSize = 0;
+
+		if(logStat.st_size > 0)
+		{
+			logMap = mmap(NULL, logStat.st_size, PROT_READ, MAP_SHARED, logFd, 0);
+			if(logMap == MAP_FAILED)
+				logMap = NULL;
+			else
+				logMapSize = logStat.st_size;
+		}
+	}
+
+	// Index, ignoring any partially written offset at the end
+	if((size_t)idxStat.st_size != idxMapSize)
+	{
+		if(idxMap != NULL)
+			munmap(idxMap, idxMapSize);
+		idxMap = NULL;
+		idxMapSize = 0;
+
+		if(idxStat.st_size > 0)
+		{
+			idxMap = mmap(NULL, idxStat.st_size, PROT_READ, MAP_SHARED, idxFd, 0);
+			if(idxMap == MAP_FAILED)
+				idxMap = NULL;
+			else
+				idxMapSize = idxStat.st_size;
+		}
+	}
+
+	histCount = (logMap != NULL && idxMap != NULL) ? (long)(idxMapSize / sizeof(uint64_t)) : 0;
+}
+
+/*
+ * START READING HISTORY
+ * Shared lock, so another shell can't truncate the files under the
+ * mappings while they're read
+ * Returns -1 if history is disabled
+ * */
+static int readBegin(void)
+{
+	if(logFd == -1)
+		return -1;
+
+	flock(logFd, LOCK_SH);
+	mapFiles();
+	return 0;
+}
+
+/*
+ * DONE READING HISTORY
+ * */
+static void readEnd(void)
+{
+	flock(logFd, LOCK_UN);
+}
+
+/*
+ * INDEX WRITE FAILED
+ * */
+static void markIndexBad(void)
+{
+	if(!idxBad)
+		outPrintf("history: cannot write index, new entries not indexed\n");
+	idxBad = 1;
+}
+
+/*
+ * GET ENTRY BOUNDS
+ * Entry num is 1-based, length doesn't include newline
+ * Returns -1 if no such entry
+ * */
+static int entryBounds(long num, char ** start, size_t * len)
+{
+	uint64_t begin, end;
+
+	if(num < 1 || num > histCount)
+		return -1;
+
+	begin = idxMap[num - 1];
+	end = (num < histCount) ? idxMap[num] : logMapSize;
+
+	// Guard against a damaged index
+	if(end > logMapSize || begin > end)
+		return -1;
+
+	if(end > begin && logMap[end - 1] == '\n')
+		end--;
+
+	*start = logMap + begin;
+	*len = end - begin;
+	return 0;
+}
+
+/*
+ * FIND ENTRY CONTAINING OFFSET
+ * Binary search of index, returns 1-based entry number
+ * */
+static long entryAt(uint64_t offset)
+{
+	long low = 0;
+	long high = histCount - 1;
+	long mid;
+
+	while(low < high)
+	{
+		mid = (low + high + 1) / 2;
+		if(idxMap[mid] <= offset)
+			low = mid;
+		else
+			high = mid - 1;
+	}
+
+	return low + 1;
+}
+
+/*
+ * COMPARE ENTRY WITH PREFIX
+ * Returns < 0, 0 if entry starts with prefix, or > 0
+ * */
+static int comparePrefix(long num, const char * prefix, size_t prefixLen)
+{
+	char * start = NULL;
+	size_t len = 0;
+	int result = 0;
+
+	if(entryBounds(num, &start, &len) == -1)
+		return -1;
+
+	result = memcmp(start, prefix, (len < prefixLen) ? len : prefixLen);
+	if(result == 0 && len < prefixLen)
+		return -1;
+	return result;
+}
+
+/*
+ * COMPARE ENTRIES BY TEXT, THEN NUMBER
+ * qsort() callback
+ * */
+static int compareEntries(const void * a, const void * b)
+{
+	long numA = *(const uint32_t *)a;
+	long numB = *(const uint32_t *)b;
+	char * startA = NULL;
+	char * startB = NULL;
+	size_t lenA = 0;
+	size_t lenB = 0;
+	int result = 0;
+
+	if(entryBounds(numA, &startA, &lenA) == -1)
+		lenA = 0;
+	if(entryBounds(numB, &startB, &lenB) == -1)
+		lenB = 0;
+
+	result = memcmp(startA, startB, (lenA < lenB) ? lenA : lenB);
+	if(result == 0 && lenA != lenB)
+		result = (lenA < lenB) ? -1 : 1;
+	if(result == 0)
+		result = (numA < numB) ? -1 : (numA > numB);
+	return result;
+}
+
+/*
+ * COMPARE ENTRY NUMBERS
+ * qsort() callback
+ * */
+static int compareNums(const void * a, const void * b)
+{
+	uint32_t numA = *(const uint32_t *)a;
+	uint32_t numB = *(const uint32_t *)b;
+
+	return (numA < numB) ? -1 : (numA > numB);
+}
+
+/*
+ * UPDATE SORTED INDEX
+ * Called with files mapped and read locked
+ * Small histories and a few new entries are left to be searched one by
+ * one, otherwise the new entries are sorted and merged in
+ * */
+static void sortIndex(void)
+{
+	uint32_t * added = NULL;
+	uint32_t * merged = NULL;
+	long numAdded = 0;
+	long i = 0;
+	long j = 0;
+	long k = 0;
+
+	// Cleared or rewritten by another shell
+	if(sortedCount > histCount || (sortedCount > 0 && idxMap[sortedCount - 1] != sortedLast))
+		sortedCount = 0;
+
+	numAdded = histCount - sortedCount;
+	if(numAdded <= HISTORY_SORT_SLACK)
+		return;
+
+	added = malloc(sizeof(uint32_t) * numAdded);
+	merged = malloc(sizeof(uint32_t) * histCount);
+	if(added == NULL || merged == NULL) exit(20);
+
+	for(i = 0; i < numAdded; i++)
+		added[i] = sortedCount + 1 + i;
+	qsort(added, numAdded, sizeof(uint32_t), compareEntries);
+
+	for(i = 0, j = 0, k = 0; k < histCount; k++)
+	{
+		if(j == numAdded || (i < sortedCount && compareEntries(&sorted[i], &added[j]) < 0))
+			merged[k] = sorted[i++];
+		else
+			merged[k] = added[j++];
+	}
+
+	free(added);
+	free(sorted);
+	sorted = merged;
+	sortedCount = histCount;
+	sortedLast = idxMap[histCount - 1];
+}
+
+/*
+ * FIND SORTED ENTRIES WITH PREFIX
+ * They're together in the sorted index, from first up to end
+ * */
+static void sortedRange(const char * prefix, size_t prefixLen, long * first, long * end)
+{
+	long low = 0;
+	long high = sortedCount;
+	long mid = 0;
+
+	// First entry not before prefix
+	while(low < high)
+	{
+		mid = low + (high - low) / 2;
+		if(comparePrefix(sorted[mid], prefix, prefixLen) < 0)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+	*first = low;
+
+	// First entry after all those starting with prefix
+	high = sortedCount;
+	while(low < high)
+	{
+		mid = low + (high - low) / 2;
+		if(comparePrefix(sorted[mid], prefix, prefixLen) <= 0)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+	*end = low;
+}
+
+/*
+ * RECOVER INDEX
+ * Makes the index agree with the log after a crash between the two writes
+ * Only the unindexed tail of the log is scanned, unless there's no index yet
+ * */
+static void recoverIndex(void)
+{
+	long count;
+	uint64_t pos = 0;
+	uint64_t offset;
+	char * newLine = NULL;
+
+	mapFiles();
+	count = idxMapSize / sizeof(uint64_t);
+
+	// Drop offsets past end of log, and any partial offset
+	while(count > 0 && (idxMap == NULL || idxMap[count - 1] >= logMapSize))
+		count--;
+	if((size_t)count * sizeof(uint64_t) != idxMapSize
+			&& ftruncate(idxFd, count * sizeof(uint64_t)) == -1)
+	{
+		markIndexBad();
+		return;
+	}
+
+	if(logMapSize == 0)
+	{
+		mapFiles();
+		return;
+	}
+
+	// Start after last indexed entry
+	if(count > 0)
+	{
+		pos = idxMap[count - 1];
+		newLine = memchr(logMap + pos, '\n', logMapSize - pos);
+		pos = (newLine == NULL) ? logMapSize : (uint64_t)(newLine - logMap) + 1;
+	}
+
+	// Index each line in the tail
+	while(pos < logMapSize)
+	{
+		offset = pos;
+		if(write(idxFd, &offset, sizeof(offset)) != sizeof(offset))
+		{
+			markIndexBad();
+			break;
+		}
+
+		newLine = memchr(logMap + pos, '\n', logMapSize - pos);
+		pos = (newLine == NULL) ? logMapSize : (uint64_t)(newLine - logMap) + 1;
+	}
+
+	// Finish a partially written last line
+	// Otherwise the next entry would be glued onto it
+	if(logMap[logMapSize - 1] != '\n' && write(logFd, "\n", 1) != 1)
+	{
+		outPrintf("history: cannot write log, history disabled\n");
+		freeHistory();
+		return;
+	}
+
+	mapFiles();
+}
+
+/*
+ * INITIALIZE HISTORY
+ * Uses $HISTFILE, or ~/.smallsh_history
+ * History is disabled if neither can be opened
+ * */
+void initHistory(void)
+{
+	char logPath[4096];
+	char idxPath[4096 + 8];
+	char * histFile = getenv("HISTFILE");
+	char * home = getenv("HOME");
+
+	if(histFile != NULL && histFile[0] != '\0')
+		snprintf(logPath, sizeof(logPath), "%s", histFile);
+	else if(home != NULL)
+		snprintf(logPath, sizeof(logPath), "%s/%s", home, HISTORY_FILE);
+	else
+		return;
+	snprintf(idxPath, sizeof(idxPath), "%s.idx", logPath);
+
+	// Children don't need these
+	logFd = open(logPath, O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0600);
+	idxFd = open(idxPath, O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0600);
+	if(logFd == -1 || idxFd == -1)
+	{
+		freeHistory();
+		return;
+	}
+
+	flock(logFd, LOCK_EX);
+	recoverIndex();
+	flock(logFd, LOCK_UN);
+}
+
+/*
+ * ADD COMMAND LINE TO HISTORY
+ * Locked so shells sharing the files keep offsets in order
+ * */
+void addHistory(char * line)
+{
+	size_t len = strcspn(line, "\n");
+	size_t i = 0;
+	uint64_t offset;
+	struct iovec entry[2];
+
+	if(logFd == -1)
+		return;
+
+	// Skip blank lines
+	while(i < len && (line[i] == ' ' || line[i] == '\t'))
+		i++;
+	if(i == len)
+		return;
+
+	entry[0].iov_base = line;
+	entry[0].iov_len = len;
+	entry[1].iov_base = "\n";
+	entry[1].iov_len = 1;
+
+	flock(logFd, LOCK_EX);
+	offset = lseek(logFd, 0, SEEK_END);
+	if(writev(logFd, entry, 2) == (ssize_t)(len + 1) && !idxBad
+			&& write(idxFd, &offset, sizeof(offset)) != sizeof(offset))
+		markIndexBad();
+	flock(logFd, LOCK_UN);
+}
+
+/*
+ * GET NUMBER OF ENTRIES
+ * */
+long getHistoryCount(void)
+{
+	long count = 0;
+
+	if(readBegin() == -1)
+		return 0;
+	count = histCount;
+	readEnd();
+
+	return count;
+}
+
+/*
+ * COPY ENTRY INTO BUFFER
+ * Entry num is 1-based, buf gets no newline
+ * Returns -1 if no such entry or it doesn't fit
+ * */
+int getHistory(long num, char * buf, size_t size)
+{
+	char * start = NULL;
+	size_t len = 0;
+	int result = -1;
+
+	if(readBegin() == -1)
+		return -1;
+	if(entryBounds(num, &start, &len) == 0 && len < size)
+	{
+		memcpy(buf, start, len);
+		buf[len] = '\0';
+		result = 0;
+	}
+	readEnd();
+
+	return result;
+}
+
+/*
+ * FIND MOST RECENT ENTRY WITH PREFIX
+ * Returns entry number, or 0 if none
+ * */
+long findHistoryPrefix(char * prefix)
+{
+	long num = 0;
+	long first = 0;
+	long end = 0;
+	size_t prefixLen = strlen(prefix);
+
+	if(readBegin() == -1)
+		return 0;
+	sortIndex();
+
+	// Entries not sorted yet are the newest, so they win
+	for(num = histCount; num > sortedCount; num--)
+	{
+		if(comparePrefix(num, prefix, prefixLen) == 0)
+			break;
+	}
+
+	if(num == sortedCount)
+	{
+		num = 0;
+		sortedRange(prefix, prefixLen, &first, &end);
+		for(; first < end; first++)
+		{
+			if(sorted[first] > num)
+				num = sorted[first];
+		}
+	}
+	readEnd();
+
+	return num;
+}
+
+/*
+ * EXPAND HISTORY RECALL
+ * A line starting with !!, !n, !-n or !prefix has its first word
+ * replaced with that history entry
+ * Returns 1 if expanded, 0 if nothing to expand, -1 if not found
+ * */
+int expandHistory(char * line, size_t size)
+{
+	char designator[256];
+	char * rest = NULL;
+	char * end = NULL;
+	char * expanded = NULL;
+	size_t wordLen = 0;
+	long num = 0;
+
+	// ! alone or followed by space is just a word
+	if(line[0] != '!' || strchr(" \t\n", line[1]) != NULL)
+		return 0;
+
+	// Split designator from rest of line
+	wordLen = strcspn(line + 1, " \t\n");
+	if(wordLen >= sizeof(designator))
+		wordLen = sizeof(designator) - 1;
+	memcpy(designator, line + 1, wordLen);
+	designator[wordLen] = '\0';
+	rest = line + 1 + wordLen;
+
+	if(!strcmp("!", designator))
+		num = getHistoryCount();
+	else if((designator[0] >= '0' && designator[0] <= '9') || designator[0] == '-')
+	{
+		num = strtol(designator, &end, 10);
+		if(*end != '\0')
+			num = 0;
+		else if(num < 0)
+			num = getHistoryCount() + 1 + num;
+	}
+	else
+		num = findHistoryPrefix(designator);
+
+	// Build expanded line
+	expanded = malloc(size);
+	if(expanded == NULL) exit(20);
+	if(getHistory(num, expanded, size) == -1 || strlen(expanded) + strlen(rest) >= size)
+	{
+		outPrintf("!%s: event not found\n", designator);
+		free(expanded);
+		return -1;
+	}
+	strcat(expanded, rest);
+	strcpy(line, expanded);
+	free(expanded);
+
+	// Show what's being run
+	outPrintf("%s", line);
+	return 1;
+}
+
+/*
+ * PRINT ENTRY
+ * */
+static void printEntry(long num)
+{
+	char * start = NULL;
+	size_t len = 0;
+
+	if(entryBounds(num, &start, &len) == 0)
+		outPrintf("%5ld  %.*s\n", num, (int)len, start);
+}
+
+/*
+ * SHOW ENTRIES FOR HISTORY BUILTIN
+ * Called with files mapped and read locked
+ * */
+static void showHistory(char ** args)
+{
+	long num = 0;
+	long show = HISTORY_SHOW;
+	char * end = NULL;
+	char * hit = NULL;
+	uint32_t * found = NULL;
+	long numFound = 0;
+	long from = 0;
+	long to = 0;
+	long i = 0;
+	size_t len = 0;
+	size_t pos = 0;
+
+	// Prefix search
+	// Matches from the sorted index, then newer ones, shown in order
+	if(args[1] != NULL && !strcmp("-p", args[1]) && args[2] != NULL)
+	{
+		len = strlen(args[2]);
+		sortIndex();
+		sortedRange(args[2], len, &from, &to);
+
+		found = malloc(sizeof(uint32_t) * (to - from + histCount - sortedCount + 1));
+		if(found == NULL) exit(20);
+		if(to > from)
+			memcpy(found, sorted + from, sizeof(uint32_t) * (to - from));
+		numFound = to - from;
+		for(num = sortedCount + 1; num <= histCount; num++)
+		{
+			if(comparePrefix(num, args[2], len) == 0)
+				found[numFound++] = num;
+		}
+
+		qsort(found, numFound, sizeof(uint32_t), compareNums);
+		for(i = 0; i < numFound; i++)
+			printEntry(found[i]);
+		free(found);
+		return;
+	}
+
+	// Substring search
+	// Scans the mapped log directly, then finds entries with the index
+	if(args[1] != NULL && !strcmp("-s", args[1]) && args[2] != NULL)
+	{
+		len = strlen(args[2]);
+		while(histCount > 0 && pos < logMapSize
+				&& (hit = memmem(logMap + pos, logMapSize - pos, args[2], len)) != NULL)
+		{
+			num = entryAt(hit - logMap);
+			printEntry(num);
+
+			// Continue after this entry
+			pos = (num < histCount) ? idxMap[num] : logMapSize;
+		}
+		return;
+	}
+
+	// Last N
+	if(args[1] != NULL)
+	{
+		show = strtol(args[1], &end, 10);
+		if(*end != '\0' || end == args[1] || show < 0)
+		{
+			outPrintf("history: invalid option %s\n", args[1]);
+			return;
+		}
+	}
+
+	num = (histCount > show) ? histCount - show + 1 : 1;
+	for(; num <= histCount; num++)
+		printEntry(num);
+}
+
+/*
+ * HISTORY BUILTIN
+ * history              show last entries
+ * history N            show last N entries
+ * history -p PREFIX    show entries starting with PREFIX
+ * history -s TEXT      show entries containing TEXT
+ * history -c           clear history
+ * */
+void historyBuiltin(char ** args)
+{
+	if(logFd == -1)
+	{
+		outPrintf("history: no history file\n");
+		return;
+	}
+
+	// Clear
+	// Index first, so a failure never leaves offsets past the end of the log
+	if(args[1] != NULL && !strcmp("-c", args[1]))
+	{
+		flock(logFd, LOCK_EX);
+		if(ftruncate(idxFd, 0) == -1 || ftruncate(logFd, 0) == -1)
+			outPrintf("history: cannot clear history\n");
+		flock(logFd, LOCK_UN);
+		return;
+	}
+
+	readBegin();
+	showHistory(args);
+	readEnd();
+}
+
+/*
+ * UNMAP AND CLOSE HISTORY FILES
+ * */
+void freeHistory(void)
+{
+	if(logMap != NULL)
+		munmap(logMap, logMapSize);
+	if(idxMap != NULL)
+		munmap(idxMap, idxMapSize);
+	if(logFd != -1)
+		close(logFd);
+	if(idxFd != -1)
+		close(idxFd);
+
+	logMap = NULL;
+	idxMap = NULL;
+	logMapSize = 0;
+	idxMapSize = 0;
+	logFd = -1;
+	idxFd = -1;
+	histCount = 0;
+
+	free(sorted);
+	sorted = NULL;
+	sortedCount = 0;
+}
@@ -0,0 +1,36 @@
+/*
+ * HISTORY HEADER FILE
+ *
+ * Persistent command history
+ * Commands are appended to a log file, and the start offset of each one
+ * is appended to an index file. Both are mmap()'d, so startup doesn't
+ * read the log and entry n is found in O(1).
+ * */
+
+#ifndef HISTORY_H
+#define HISTORY_H
+
+// Header files
+#include <stdio.h>
+#include <stdlib.h>
+
+// Constants
+#ifndef HISTORY_FILE
+#define HISTORY_FILE ".smallsh_history"
+#endif
+
+#ifndef HISTORY_SHOW
+#define HISTORY_SHOW 25
+#endif
+
+// Function prototypes
+void initHistory(void);										// Open and map history files
+void addHistory(char * line);								// Append command line
+long getHistoryCount(void);									// Number of entries
+int getHistory(long num, char * buf, size_t size);			// Copy entry num (1-based) into buf
+long findHistoryPrefix(char * prefix);						// Most recent entry starting with prefix
+int expandHistory(char * line, size_t size);				// Expand !n, !-n, !!, !prefix
+void historyBuiltin(char ** args);							// history builtin
+void freeHistory(void);										// Unmap and close
+
+#endif
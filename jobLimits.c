@@ -0,0 +1,259 @@
+/*
+ * JOB LIMITS IMPLEMENTATION FILE
+ *
+ * ulimit-style resource limits applied with setrlimit()
+ * in the child process before exec()
+ * */
+
+// Header files
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "jobLimits.h"
+#include "output.h"
+
+// Shell-wide limits for all jobs launched
+// The shell itself is never limited
+struct JobLimits jobLimitDefault = { {0, 0, 0, 0}, {0, 0, 0, 0} };
+
+// Option letters, resource numbers, names and scale (user units to rlimit units)
+// indexed by LIMIT_*
+static const char limitOpts[LIMIT_COUNT] = { 'v', 't', 'n', 'u' };
+static const int limitResources[LIMIT_COUNT] = { RLIMIT_AS, RLIMIT_CPU, RLIMIT_NOFILE, RLIMIT_NPROC };
+static const char * limitNames[LIMIT_COUNT] = { "address space (kbytes)", "cpu time (seconds)", "open files", "processes" };
+static const rlim_t limitScale[LIMIT_COUNT] = { 1024, 1, 1, 1 };
+
+/*
+ * INITIALIZE LIMITS
+ * */
+void initLimits(struct JobLimits * limits)
+{
+	int i = 0;
+
+	for(i = 0; i < LIMIT_COUNT; i++)
+	{
+		limits->set[i] = 0;
+		limits->val[i] = RLIM_INFINITY;
+	}
+}
+
+/*
+ * FIND LIMIT FOR OPTION
+ * Returns LIMIT_* index for "-v", "-t" etc, or -1
+ * */
+static int findLimit(char * opt)
+{
+	int i = 0;
+
+	if(opt[0] != '-' || opt[1] == '\0' || opt[2] != '\0')
+		return -1;
+
+	for(i = 0; i < LIMIT_COUNT; i++)
+	{
+		if(limitOpts[i] == opt[1])
+			return i;
+	}
+	return -1;
+}
+
+/*
+ * PARSE LIMIT VALUE
+ * Number in user units, or "unlimited"
+ * Numbers too big for setrlimit() units are rejected, not wrapped
+ * */
+static int parseLimitVal(int limit, char * str, rlim_t * val)
+{
+	char * end = NULL;
+	unsigned long long num;
+
+	if(str == NULL)
+		return -1;
+
+	if(!strcmp("unlimited", str))
+	{
+		*val = RLIM_INFINITY;
+		return 0;
+	}
+
+	if(str[0] < '0' || str[0] > '9')
+		return -1;
+	errno = 0;
+	num = strtoull(str, &end, 10);
+	if(*end != '\0' || errno == ERANGE || num >= RLIM_INFINITY / limitScale[limit])
+		return -1;
+
+	*val = (rlim_t)num * limitScale[limit];
+	return 0;
+}
+
+/*
+ * PARSE LIMIT OPTIONS
+ * Reads "-X VAL" pairs from front of args
+ * Returns number of words used, or -1 if malformed
+ * */
+static int parseLimitOpts(char ** args, struct JobLimits * limits)
+{
+	int i = 0;
+	int limit = -1;
+	rlim_t val;
+
+	while(args[i] != NULL && args[i][0] == '-')
+	{
+		limit = findLimit(args[i]);
+		if(limit == -1 || parseLimitVal(limit, args[i+1], &val))
+		{
+			outPrintf("ulimit: invalid option %s\n", args[i]);
+			return -1;
+		}
+
+		limits->set[limit] = 1;
+		limits->val[limit] = val;
+		i += 2;
+	}
+
+	return i;
+}
+
+/*
+ * PARSE LIMIT PREFIX
+ * Looks at front of args for "ulimit -X VAL ... cmd"
+ * Returns number of words used, 0 if not a prefix, or -1 if malformed
+ * */
+int parseLimitPrefix(char ** args, struct JobLimits * limits)
+{
+	int used = 0;
+
+	if(!limitHasCommand(args))
+		return 0;
+
+	used = parseLimitOpts(&args[1], limits);
+	if(used == -1)
+		return -1;
+
+	return used + 1;
+}
+
+/*
+ * IS ULIMIT PREFIXING A COMMAND
+ * True if args are "ulimit", at least one valid -X VAL pair, then
+ * another word
+ * */
+int limitHasCommand(char ** args)
+{
+	int i = 1;
+	int limit = -1;
+	rlim_t val;
+
+	if(args[0] == NULL || strcmp("ulimit", args[0]))
+		return 0;
+
+	// Skip option pairs
+	while(args[i] != NULL && (limit = findLimit(args[i])) != -1
+			&& parseLimitVal(limit, args[i+1], &val) == 0)
+		i += 2;
+
+	return (i > 1 && args[i] != NULL && args[i][0] != '-');
+}
+
+/*
+ * MERGE DEFAULT LIMITS
+ * Limits given explicitly for a job take precedence
+ * */
+void mergeLimits(struct JobLimits * limits, struct JobLimits * defaults)
+{
+	int i = 0;
+
+	for(i = 0; i < LIMIT_COUNT; i++)
+	{
+		if(!limits->set[i] && defaults->set[i])
+		{
+			limits->set[i] = 1;
+			limits->val[i] = defaults->val[i];
+		}
+	}
+}
+
+/*
+ * APPLY LIMITS
+ * Called in child process before exec()
+ * Lowers the soft and hard limit together, so the job can't raise it again
+ * Returns 0 on success, -1 on any error
+ * */
+int applyLimits(struct JobLimits * limits)
+{
+	int i = 0;
+	int result = 0;
+	struct rlimit rlim;
+
+	for(i = 0; i < LIMIT_COUNT; i++)
+	{
+		if(!limits->set[i])
+			continue;
+
+		// unlimited can only go as high as the inherited hard limit
+		if(limits->val[i] == RLIM_INFINITY)
+		{
+			getrlimit(limitResources[i], &rlim);
+			rlim.rlim_cur = rlim.rlim_max;
+		}
+		else
+		{
+			rlim.rlim_cur = limits->val[i];
+			rlim.rlim_max = limits->val[i];
+		}
+
+		if(setrlimit(limitResources[i], &rlim) == -1)
+		{
+			outPrintf("ulimit: cannot set %s limit\n", limitNames[i]);
+			result = -1;
+		}
+	}
+
+	return result;
+}
+
+/*
+ * ULIMIT BUILTIN
+ * ulimit                   show limits for launched jobs
+ * ulimit -X VAL ...        set limits for all launched jobs
+ * ulimit -X unlimited      clear a limit
+ * */
+void limitsBuiltin(char ** args)
+{
+	int i = 0;
+	int used = 0;
+	struct JobLimits newLimits = jobLimitDefault;
+
+	// No args, show current limits
+	if(args[1] == NULL)
+	{
+		for(i = 0; i < LIMIT_COUNT; i++)
+		{
+			if(jobLimitDefault.set[i] && jobLimitDefault.val[i] != RLIM_INFINITY)
+				outPrintf("-%c %-24s %llu\n", limitOpts[i], limitNames[i],
+						(unsigned long long)(jobLimitDefault.val[i] / limitScale[i]));
+			else
+				outPrintf("-%c %-24s unlimited\n", limitOpts[i], limitNames[i]);
+		}
+		return;
+	}
+
+	// Only update defaults if all options were valid
+	used = parseLimitOpts(&args[1], &newLimits);
+	if(used == -1)
+		return;
+	if(args[used + 1] != NULL)
+	{
+		outPrintf("usage: ulimit [-X VALUE]... [COMMAND]\n");
+		return;
+	}
+
+	// unlimited means don't touch the job's inherited limit
+	for(i = 0; i < LIMIT_COUNT; i++)
+	{
+		if(newLimits.val[i] == RLIM_INFINITY)
+			newLimits.set[i] = 0;
+	}
+	jobLimitDefault = newLimits;
+}
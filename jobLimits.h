@@ -0,0 +1,36 @@
+/*
+ * JOB LIMITS HEADER FILE
+ *
+ * ulimit-style resource limits applied with setrlimit()
+ * in the child process before exec()
+ * */
+
+#ifndef JOB_LIMITS_H
+#define JOB_LIMITS_H
+
+// Header files
+#include <sys/resource.h>
+
+// Limits supported, used as indexes into JobLimits arrays
+#define LIMIT_AS 0											// -v address space, in KB
+#define LIMIT_CPU 1											// -t cpu time, in seconds
+#define LIMIT_NOFILE 2										// -n open files
+#define LIMIT_NPROC 3										// -u processes
+#define LIMIT_COUNT 4
+
+// Job Limits Struct
+struct JobLimits
+{
+	int set[LIMIT_COUNT];									// Should this limit be applied
+	rlim_t val[LIMIT_COUNT];								// Value of limit, in setrlimit() units
+};
+
+// Function Prototypes
+void initLimits(struct JobLimits * limits);					// Initialize to no limits
+int parseLimitPrefix(char ** args, struct JobLimits * limits);	// Parse "ulimit OPTS", returns words used
+int limitHasCommand(char ** args);							// Is "ulimit OPTS" followed by a command
+void mergeLimits(struct JobLimits * limits, struct JobLimits * defaults);	// Fill unset limits from defaults
+int applyLimits(struct JobLimits * limits);					// Apply in child before exec
+void limitsBuiltin(char ** args);							// ulimit builtin
+
+#endif
@@ -0,0 +1,389 @@
+/*
+ * JOB SCHEDULING IMPLEMENTATION FILE
+ *
+ * Launch-time scheduling controls (cpuset, nice, ionice) applied
+ * in the child process before exec()
+ * */
+
+// Needed for CPU_* macros and sched_setaffinity()
+#define _GNU_SOURCE
+
+// Header files
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include "jobSched.h"
+#include "output.h"
+
+// ioprio_set() has no glibc wrapper
+#define IOPRIO_WHO_PROCESS 1
+#define IOPRIO_CLASS_SHIFT 13
+#define IOPRIO_LEVEL_DEFAULT 4
+
+// Shell-wide default policy for background processes
+// Off until bgsched turns it on, then bg jobs get lower CPU and I/O
+// priority than fg jobs
+int bgSchedOn = 0;
+struct SchedOpts bgSchedDefault = {
+	.niceSet = 1, .niceVal = 10,
+	.ioSet = 1, .ioClass = IOCLASS_BESTEFFORT, .ioLevel = 7,
+	.cpuSet = 0
+};
+
+// Names of I/O classes, indexed by class number
+static const char * ioClassNames[] = { "none", "realtime", "best-effort", "idle" };
+
+/*
+ * INITIALIZE SCHEDULING OPTIONS
+ * */
+void initSched(struct SchedOpts * opts)
+{
+	opts->niceSet = 0;
+	opts->niceVal = 0;
+	opts->ioSet = 0;
+	opts->ioClass = IOCLASS_NONE;
+	opts->ioLevel = 0;
+	opts->cpuSet = 0;
+	CPU_ZERO(&opts->cpus);
+}
+
+/*
+ * PARSE INTEGER
+ * Returns 0 on success, -1 if string is not entirely a number or
+ * doesn't fit in an int
+ * */
+static int parseInt(char * str, int * val)
+{
+	char * end = NULL;
+	long num;
+
+	if(str == NULL || *str == '\0')
+		return -1;
+
+	errno = 0;
+	num = strtol(str, &end, 10);
+	if(*end != '\0' || errno == ERANGE || num < INT_MIN || num > INT_MAX)
+		return -1;
+
+	*val = (int)num;
+	return 0;
+}
+
+/*
+ * PARSE I/O CLASS
+ * Accepts a class name or number, optionally followed by :LEVEL
+ * e.g. "idle", "best-effort:7", "2:4"
+ * */
+static int parseIoClass(char * str, struct SchedOpts * opts)
+{
+	char buffer[32];
+	char * levelStr = NULL;
+	int i, ioClass = -1, level = IOPRIO_LEVEL_DEFAULT;
+
+	if(strlen(str) >= sizeof(buffer))
+		return -1;
+	strcpy(buffer, str);
+
+	// Split off level if given
+	levelStr = strchr(buffer, ':');
+	if(levelStr != NULL)
+	{
+		*levelStr = '\0';
+		levelStr++;
+		if(parseInt(levelStr, &level) || level < 0 || level > 7)
+			return -1;
+	}
+
+	// Match name, then number
+	for(i = 0; i < 4; i++)
+	{
+		if(!strcmp(ioClassNames[i], buffer))
+			ioClass = i;
+	}
+	if(ioClass == -1 && (parseInt(buffer, &ioClass) || ioClass < 0 || ioClass > 3))
+		return -1;
+
+	opts->ioSet = 1;
+	opts->ioClass = ioClass;
+	opts->ioLevel = level;
+	return 0;
+}
+
+/*
+ * PARSE CPU LIST
+ * Format like taskset -c, e.g. "0-7,12,14-15"
+ * */
+static int parseCpuList(char * str, struct SchedOpts * opts)
+{
+	char * cur = str;
+	char * end = NULL;
+	long first, last, i;
+	cpu_set_t cpus;
+
+	CPU_ZERO(&cpus);
+
+	while(*cur != '\0')
+	{
+		// First cpu of range
+		first = strtol(cur, &end, 10);
+		if(end == cur || first < 0)
+			return -1;
+		last = first;
+		cur = end;
+
+		// Optional end of range
+		if(*cur == '-')
+		{
+			cur++;
+			last = strtol(cur, &end, 10);
+			if(end == cur || last < first)
+				return -1;
+			cur = end;
+		}
+
+		if(last >= CPU_SETSIZE)
+			return -1;
+		for(i = first; i <= last; i++)
+			CPU_SET(i, &cpus);
+
+		// Separator
+		if(*cur == ',')
+			cur++;
+		else if(*cur != '\0')
+			return -1;
+	}
+
+	if(CPU_COUNT(&cpus) == 0)
+		return -1;
+
+	opts->cpuSet = 1;
+	opts->cpus = cpus;
+	return 0;
+}
+
+/*
+ * PARSE SCHEDULING PREFIX
+ * Looks at the front of args for "nice N", "ionice CLASS" or "cpuset LIST"
+ * nice also takes -n N and -N like coreutils, so nice -5 is +5
+ * Returns number of words used, 0 if not a prefix, or -1 if malformed
+ * */
+int parseSchedPrefix(char ** args, struct SchedOpts * opts)
+{
+	int val;
+
+	// Prefix needs at least one argument
+	if(args[0] == NULL || args[1] == NULL)
+		return 0;
+
+	// nice -n N, or nice N
+	// If N isn't a number, leave it for the real nice program
+	if(!strcmp("nice", args[0]) && !strcmp("-n", args[1]))
+	{
+		if(parseInt(args[2], &val))
+			return 0;
+		opts->niceSet = 1;
+		opts->niceVal = val;
+		return 3;
+	}
+	if(!strcmp("nice", args[0]))
+	{
+		// Old coreutils form, -N is an increment of N and --N is -N
+		if(args[1][0] == '-' ? parseInt(args[1] + 1, &val) : parseInt(args[1], &val))
+			return 0;
+		opts->niceSet = 1;
+		opts->niceVal = val;
+		return 2;
+	}
+
+	// ionice CLASS[:LEVEL]
+	// If CLASS isn't recognized, leave it for the real ionice program
+	if(!strcmp("ionice", args[0]))
+	{
+		if(parseIoClass(args[1], opts))
+			return 0;
+		return 2;
+	}
+
+	// cpuset LIST
+	if(!strcmp("cpuset", args[0]))
+	{
+		if(parseCpuList(args[1], opts))
+		{
+			outPrintf("cpuset: invalid cpu list %s\n", args[1]);
+			return -1;
+		}
+		return 2;
+	}
+
+	return 0;
+}
+
+/*
+ * MERGE DEFAULT OPTIONS
+ * Options given explicitly for a job take precedence
+ * */
+void mergeSched(struct SchedOpts * opts, struct SchedOpts * defaults)
+{
+	if(!opts->niceSet && defaults->niceSet)
+	{
+		opts->niceSet = 1;
+		opts->niceVal = defaults->niceVal;
+	}
+
+	if(!opts->ioSet && defaults->ioSet)
+	{
+		opts->ioSet = 1;
+		opts->ioClass = defaults->ioClass;
+		opts->ioLevel = defaults->ioLevel;
+	}
+
+	if(!opts->cpuSet && defaults->cpuSet)
+	{
+		opts->cpuSet = 1;
+		opts->cpus = defaults->cpus;
+	}
+}
+
+/*
+ * APPLY SCHEDULING OPTIONS
+ * Called in child process before exec()
+ * Returns 0 on success, -1 on any error
+ * */
+int applySched(struct SchedOpts * opts)
+{
+	int result = 0;
+
+	// CPU affinity
+	if(opts->cpuSet && sched_setaffinity(0, sizeof(cpu_set_t), &opts->cpus) == -1)
+	{
+		outPrintf("cpuset: cannot set cpu affinity\n");
+		result = -1;
+	}
+
+	// Niceness
+	// nice() can legitimately return -1, so check errno instead
+	if(opts->niceSet)
+	{
+		errno = 0;
+		if(nice(opts->niceVal) == -1 && errno != 0)
+		{
+			outPrintf("nice: cannot set niceness %d\n", opts->niceVal);
+			result = -1;
+		}
+	}
+
+	// I/O priority
+	if(opts->ioSet)
+	{
+		int ioprio = (opts->ioClass << IOPRIO_CLASS_SHIFT) | opts->ioLevel;
+		if(syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, ioprio) == -1)
+		{
+			outPrintf("ionice: cannot set %s i/o priority\n", ioClassNames[opts->ioClass]);
+			result = -1;
+		}
+	}
+
+	return result;
+}
+
+/*
+ * PRINT SCHEDULING OPTIONS
+ * */
+void printSched(struct SchedOpts * opts)
+{
+	int i, first, printed = 0;
+
+	if(opts->niceSet)
+	{
+		outPrintf("nice -n %d ", opts->niceVal);
+		printed = 1;
+	}
+
+	if(opts->ioSet)
+	{
+		outPrintf("ionice %s:%d ", ioClassNames[opts->ioClass], opts->ioLevel);
+		printed = 1;
+	}
+
+	// Print cpus as ranges
+	if(opts->cpuSet)
+	{
+		outPrintf("cpuset ");
+		first = 1;
+		for(i = 0; i < CPU_SETSIZE; i++)
+		{
+			if(!CPU_ISSET(i, &opts->cpus))
+				continue;
+
+			outPrintf(first ? "%d" : ",%d", i);
+			first = 0;
+
+			// Skip to end of run
+			if(i + 1 < CPU_SETSIZE && CPU_ISSET(i + 1, &opts->cpus))
+			{
+				while(i + 1 < CPU_SETSIZE && CPU_ISSET(i + 1, &opts->cpus))
+					i++;
+				outPrintf("-%d", i);
+			}
+		}
+		outPrintf(" ");
+		printed = 1;
+	}
+
+	if(!printed)
+		outPrintf("(none)");
+
+	outPrintf("\n");
+}
+
+/*
+ * BGSCHED BUILTIN
+ * bgsched                  show background policy
+ * bgsched on|off           enable/disable background policy
+ * bgsched reset            clear background policy
+ * bgsched [nice [-n] N] [ionice CLASS] [cpuset LIST]
+ * */
+void bgSchedBuiltin(char ** args)
+{
+	int i = 1;
+	int used = 0;
+	struct SchedOpts newSched = bgSchedDefault;
+
+	// No args, show current policy
+	if(args[1] == NULL)
+	{
+		outPrintf("bgsched %s: ", bgSchedOn ? "on" : "off");
+		printSched(&bgSchedDefault);
+		return;
+	}
+
+	if(!strcmp("on", args[1]) || !strcmp("off", args[1]))
+	{
+		bgSchedOn = !strcmp("on", args[1]);
+		return;
+	}
+
+	if(!strcmp("reset", args[1]))
+	{
+		initSched(&bgSchedDefault);
+		return;
+	}
+
+	// Otherwise parse options, only updating the policy if all were valid
+	while(args[i] != NULL)
+	{
+		used = parseSchedPrefix(&args[i], &newSched);
+		if(used <= 0)
+		{
+			outPrintf("bgsched: invalid option %s\n", args[i]);
+			return;
+		}
+		i += used;
+	}
+	bgSchedDefault = newSched;
+	bgSchedOn = 1;
+}
@@ -0,0 +1,40 @@
+/*
+ * JOB SCHEDULING HEADER FILE
+ *
+ * Launch-time scheduling controls (cpuset, nice, ionice) applied
+ * in the child process before exec()
+ * */
+
+#ifndef JOB_SCHED_H
+#define JOB_SCHED_H
+
+// Header files
+#include <sched.h>
+
+// I/O scheduling classes, matching the kernel's ioprio classes
+#define IOCLASS_NONE 0
+#define IOCLASS_REALTIME 1
+#define IOCLASS_BESTEFFORT 2
+#define IOCLASS_IDLE 3
+
+// Scheduling Options Struct
+struct SchedOpts
+{
+	int niceSet;									// Should niceness be adjusted
+	int niceVal;									// Niceness increment
+	int ioSet;										// Should I/O priority be changed
+	int ioClass;									// I/O scheduling class
+	int ioLevel;									// I/O priority level within class (0-7)
+	int cpuSet;										// Should CPU affinity be changed
+	cpu_set_t cpus;									// CPUs the job may run on
+};
+
+// Function Prototypes
+void initSched(struct SchedOpts * opts);						// Initialize to no changes
+int parseSchedPrefix(char ** args, struct SchedOpts * opts);	// Parse one prefix, returns words used
+void mergeSched(struct SchedOpts * opts, struct SchedOpts * defaults);	// Fill unset fields from defaults
+int applySched(struct SchedOpts * opts);						// Apply in child before exec
+void printSched(struct SchedOpts * opts);						// Print options set
+void bgSchedBuiltin(char ** args);								// bgsched builtin
+
+#endif
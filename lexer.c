@@ -0,0 +1,527 @@
+/*
+ * LEXER IMPLEMENTATION FILE
+ *
+ * Splits a command line into words and operators
+ * Handles single quotes, double quotes, backslash escapes and $$
+ * Delimiters and quote characters are found with SSE2/AVX2 when
+ * available, with a scalar fallback
+ * */
+
+// Header files
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "lexer.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define LEX_X86 1
+#endif
+
+// Most characters a scanner looks for at once
+#define SCAN_SET_MAX 16
+
+// Initial token capacity
+#define TOKENS_START 16
+
+// Set of characters a scanner stops at
+struct ScanSet
+{
+	int count;							// Number of characters in set
+	char chars[SCAN_SET_MAX];			// Characters, for vector compares
+	unsigned char member[256];			// Lookup table, for scalar compares
+};
+
+// Scanner function, returns index of first character in set, or len
+typedef size_t (*ScanFunc)(const char * str, size_t len, const struct ScanSet * set);
+
+// Characters that end a run of plain word characters
+// Outside quotes, and inside double quotes
+static struct ScanSet plainSet;
+static struct ScanSet doubleSet;
+
+// Scanner picked for this CPU
+static ScanFunc scan = NULL;
+
+// Shell pid as text, for $$
+static char pidText[16];
+static size_t pidLen = 0;
+
+/*
+ * SCALAR SCANNER
+ * */
+static size_t scanScalar(const char * str, size_t len, const struct ScanSet * set)
+{
+	size_t i = 0;
+
+	for(i = 0; i < len; i++)
+	{
+		if(set->member[(unsigned char)str[i]])
+			return i;
+	}
+	return len;
+}
+
+#if defined(__SSE2__)
+/*
+ * SSE2 SCANNER
+ * Compares 16 bytes against every character in the set at once
+ * */
+static size_t scanSSE2(const char * str, size_t len, const struct ScanSet * set)
+{
+	__m128i targets[SCAN_SET_MAX];
+	__m128i block, hits;
+	size_t i = 0;
+	int k = 0;
+	int mask = 0;
+
+	for(k = 0; k < set->count; k++)
+		targets[k] = _mm_set1_epi8(set->chars[k]);
+
+	for(i = 0; i + 16 <= len; i += 16)
+	{
+		block = _mm_loadu_si128((const __m128i *)(str + i));
+		hits = _mm_cmpeq_epi8(block, targets[0]);
+		for(k = 1; k < set->count; k++)
+			hits = _mm_or_si128(hits, _mm_cmpeq_epi8(block, targets[k]));
+
+		mask = _mm_movemask_epi8(hits);
+		if(mask)
+			return i + __builtin_ctz(mask);
+	}
+
+	// Tail shorter than a vector
+	return i + scanScalar(str + i, len - i, set);
+}
+#endif
+
+#if defined(LEX_X86)
+/*
+ * AVX2 SCANNER
+ * Compares 32 bytes against every character in the set at once
+ * Only called when the CPU reports AVX2
+ * */
+__attribute__((target("avx2")))
+static size_t scanAVX2(const char * str, size_t len, const struct ScanSet * set)
+{
+	__m256i targets[SCAN_SET_MAX];
+	__m256i block, hits;
+	size_t i = 0;
+	int k = 0;
+	unsigned int mask = 0;
+
+	for(k = 0; k < set->count; k++)
+		targets[k] = _mm256_set1_epi8(set->chars[k]);
+
+	for(i = 0; i + 32 <= len; i += 32)
+	{
+		block = _mm256_loadu_si256((const __m256i *)(str + i));
+		hits = _mm256_cmpeq_epi8(block, targets[0]);
+		for(k = 1; k < set->count; k++)
+			hits = _mm256_or_si256(hits, _mm256_cmpeq_epi8(block, targets[k]));
+
+		mask = (unsigned int)_mm256_movemask_epi8(hits);
+		if(mask)
+			return i + __builtin_ctz(mask);
+	}
+
+	// Tail shorter than a vector
+	return i + scanScalar(str + i, len - i, set);
+}
+#endif
+
+/*
+ * BUILD SCAN SET
+ * */
+static void initScanSet(struct ScanSet * set, const char * chars)
+{
+	memset(set, 0, sizeof(struct ScanSet));
+	while(*chars != '\0' && set->count < SCAN_SET_MAX)
+	{
+		set->chars[set->count++] = *chars;
+		set->member[(unsigned char)*chars] = 1;
+		chars++;
+	}
+}
+
+/*
+ * SET UP LEXER
+ * Picks fastest scanner for this CPU, done once
+ * Done by first lexLine() call, or up front if lexing from more than one thread
+ * */
+void initLexer(void)
+{
+	if(scan != NULL)
+		return;
+
+	initScanSet(&plainSet, " \t\n'\"\\$<>&|");
+	initScanSet(&doubleSet, "\"\\$");
+
+	scan = scanScalar;
+#if defined(__SSE2__)
+	scan = scanSSE2;
+#endif
+#if defined(LEX_X86)
+	__builtin_cpu_init();
+	if(__builtin_cpu_supports("avx2"))
+		scan = scanAVX2;
+#endif
+
+	pidLen = snprintf(pidText, sizeof(pidText), "%d", (int)getpid());
+}
+
+/*
+ * INITIALIZE TOKEN LIST
+ * */
+void initTokens(struct TokenList * list)
+{
+	list->tokens = NULL;
+	list->count = 0;
+	list->capacity = 0;
+	list->store = NULL;
+	list->storeUsed = 0;
+	list->storeSize = 0;
+}
+
+/*
+ * ADD TOKEN
+ * Text is whatever is in store from start to storeUsed
+ * */
+static void addToken(struct TokenList * list, int type, size_t start, int quoted)
+{
+	// Grow array if needed
+	if(list->count == list->capacity)
+	{
+		list->capacity = list->capacity ? list->capacity * 2 : TOKENS_START;
+		list->tokens = realloc(list->tokens, sizeof(struct Token) * list->capacity);
+		if(list->tokens == NULL) exit(20);
+	}
+
+	list->store[list->storeUsed++] = '\0';
+	list->tokens[list->count].type = type;
+	list->tokens[list->count].text = list->store + start;
+	list->tokens[list->count].quoted = quoted;
+	list->count++;
+}
+
+/*
+ * ADD OPERATOR TOKEN
+ * */
+static void addOperator(struct TokenList * list, int type, const char * text)
+{
+	size_t start = list->storeUsed;
+	size_t len = strlen(text);
+
+	memcpy(list->store + list->storeUsed, text, len);
+	list->storeUsed += len;
+	addToken(list, type, start, 0);
+}
+
+/*
+ * APPEND TO CURRENT WORD
+ * */
+static void append(struct TokenList * list, const char * text, size_t len)
+{
+	memcpy(list->store + list->storeUsed, text, len);
+	list->storeUsed += len;
+}
+
+/*
+ * HANDLE $
+ * $$ becomes the shell's pid, anything else is a plain $
+ * Returns characters used
+ * */
+static size_t lexDollar(struct TokenList * list, const char * line, size_t pos, size_t len)
+{
+	if(pos + 1 < len && line[pos + 1] == '$')
+	{
+		append(list, pidText, pidLen);
+		return 2;
+	}
+
+	append(list, "$", 1);
+	return 1;
+}
+
+/*
+ * LEX LINE
+ * Replaces any tokens already in list
+ * Returns LEX_OK, or LEX_UNTERMINATED if a quote was never closed
+ * */
+int lexLine(struct TokenList * list, const char * line, size_t len)
+{
+	size_t pos = 0;
+	size_t run = 0;
+	size_t wordStart = 0;
+	int inWord = 0;
+	int quoted = 0;
+	const char * close = NULL;
+	char c;
+
+	if(scan == NULL)
+		initLexer();
+
+	// Output can't be longer than input, except for $$ expansions
+	// Each 2 character $$ grows to at most pidLen, plus a NUL per token
+	list->count = 0;
+	list->storeUsed = 0;
+	if(list->storeSize < len * (pidLen + 1) + 16)
+	{
+		list->storeSize = len * (pidLen + 1) + 16;
+		free(list->store);
+		list->store = malloc(list->storeSize);
+		if(list->store == NULL) exit(20);
+	}
+
+	while(pos < len)
+	{
+		// Copy run of plain characters
+		run = scan(line + pos, len - pos, &plainSet);
+		if(run > 0)
+		{
+			if(!inWord)
+			{
+				inWord = 1;
+				wordStart = list->storeUsed;
+			}
+			append(list, line + pos, run);
+			pos += run;
+			if(pos == len)
+				break;
+		}
+
+		c = line[pos];
+
+		// Whitespace or operator ends current word
+		if(strchr(" \t\n<>&|", c) != NULL)
+		{
+			if(inWord)
+			{
+				addToken(list, TOK_WORD, wordStart, quoted);
+				inWord = 0;
+				quoted = 0;
+			}
+
+			switch(c)
+			{
+				case '<':
+					addOperator(list, TOK_LT, "<");
+					break;
+				case '>':
+					if(pos + 1 < len && line[pos + 1] == '>')
+					{
+						addOperator(list, TOK_GTGT, ">>");
+						pos++;
+					}
+					else
+						addOperator(list, TOK_GT, ">");
+					break;
+				case '&':
+					addOperator(list, TOK_AMP, "&");
+					break;
+				case '|':
+					addOperator(list, TOK_PIPE, "|");
+					break;
+			}
+			pos++;
+			continue;
+		}
+
+		// Anything else is part of a word
+		if(!inWord)
+		{
+			inWord = 1;
+			wordStart = list->storeUsed;
+		}
+
+		switch(c)
+		{
+			// Single quotes, everything literal until next '
+			case '\'':
+				close = memchr(line + pos + 1, '\'', len - pos - 1);
+				if(close == NULL)
+					return LEX_UNTERMINATED;
+				append(list, line + pos + 1, close - (line + pos + 1));
+				pos = (close - line) + 1;
+				quoted = 1;
+				break;
+
+			// Double quotes, backslash and $$ still work
+			case '"':
+				pos++;
+				quoted = 1;
+				while(1)
+				{
+					run = scan(line + pos, len - pos, &doubleSet);
+					append(list, line + pos, run);
+					pos += run;
+					if(pos == len)
+						return LEX_UNTERMINATED;
+
+					c = line[pos];
+					if(c == '"')
+					{
+						pos++;
+						break;
+					}
+					else if(c == '$')
+						pos += lexDollar(list, line, pos, len);
+					else
+					{
+						// Backslash only escapes these inside double quotes
+						if(pos + 1 < len && strchr("\"\\$", line[pos + 1]) != NULL)
+						{
+							append(list, line + pos + 1, 1);
+							pos += 2;
+						}
+						else if(pos + 1 < len && line[pos + 1] == '\n')
+							pos += 2;
+						else
+						{
+							append(list, "\\", 1);
+							pos++;
+						}
+					}
+				}
+				break;
+
+			// Backslash, next character is literal
+			// Backslash-newline joins lines
+			case '\\':
+				if(pos + 1 < len && line[pos + 1] != '\n')
+				{
+					append(list, line + pos + 1, 1);
+					quoted = 1;
+				}
+				else if(list->storeUsed == wordStart && !quoted)
+					inWord = 0;
+				pos += 2;
+				break;
+
+			case '$':
+				pos += lexDollar(list, line, pos, len);
+				break;
+		}
+	}
+
+	// Last word
+	if(inWord)
+		addToken(list, TOK_WORD, wordStart, quoted);
+
+	return LEX_OK;
+}
+
+/*
+ * FREE TOKEN LIST
+ * */
+void freeTokens(struct TokenList * list)
+{
+	free(list->tokens);
+	free(list->store);
+	initTokens(list);
+}
+
+/*
+ * COMPARE TOKEN LISTS
+ * */
+static int sameTokens(const struct TokenList * a, const struct TokenList * b)
+{
+	int i = 0;
+
+	if(a->count != b->count)
+		return 0;
+
+	for(i = 0; i < a->count; i++)
+	{
+		if(a->tokens[i].type != b->tokens[i].type || a->tokens[i].quoted != b->tokens[i].quoted
+				|| strcmp(a->tokens[i].text, b->tokens[i].text))
+			return 0;
+	}
+	return 1;
+}
+
+/*
+ * CHECK VECTOR SCANNERS AGAINST SCALAR
+ * Lexes quoting, escape and $$ edge cases with each scanner this CPU
+ * has, shifted so every special character lands on each vector lane
+ * and boundary, and compares the tokens with the scalar scanner's
+ * Swaps the scanner in use, so not safe while other threads are lexing
+ * Returns number of mismatches, each printed to stderr
+ * */
+int checkScanners(void)
+{
+	static const char * cases[] = {
+		"", " ", "\t\n", "a", "echo hi",
+		"'it''s'", "'a b'c\"d e\"f", "\"'\"", "'\"'", "\"\"", "''", "a''b",
+		"'unterminated", "\"unterminated", "\"a\\\"b\"", "'a\\b'",
+		"a\\ b", "\\", "a\\", "\\$$", "\\'x",
+		"$", "$$", "$$$", "$$$$", "x$", "$x", "\"$$\"", "'$$'", "\"a$\"", "\"$",
+		"a>>b", "a>b<c", "a&", "& a", "a|tee f", "a||b", "<>>&|",
+		"\xff\x80'\xc3\xa9 x'\"\x7f\"",
+	};
+	struct
+	{
+		const char * name;
+		ScanFunc func;
+	} vectors[2];
+	int numVectors = 0;
+	char line[128];
+	struct TokenList expected;
+	struct TokenList got;
+	ScanFunc saved = NULL;
+	size_t len = 0;
+	size_t shift = 0;
+	int expectedResult = 0;
+	int gotResult = 0;
+	int mismatches = 0;
+	int i = 0;
+	int v = 0;
+
+	initLexer();
+	saved = scan;
+
+#if defined(__SSE2__)
+	vectors[numVectors].name = "SSE2";
+	vectors[numVectors++].func = scanSSE2;
+#endif
+#if defined(LEX_X86)
+	if(__builtin_cpu_supports("avx2"))
+	{
+		vectors[numVectors].name = "AVX2";
+		vectors[numVectors++].func = scanAVX2;
+	}
+#endif
+
+	initTokens(&expected);
+	initTokens(&got);
+	for(i = 0; i < (int)(sizeof(cases) / sizeof(cases[0])); i++)
+	{
+		// Pad with word characters from 0 to past one AVX2 vector
+		for(shift = 0; shift <= 33; shift++)
+		{
+			len = strlen(cases[i]);
+			memset(line, 'w', shift);
+			memcpy(line + shift, cases[i], len + 1);
+			len += shift;
+
+			scan = scanScalar;
+			expectedResult = lexLine(&expected, line, len);
+			for(v = 0; v < numVectors; v++)
+			{
+				scan = vectors[v].func;
+				gotResult = lexLine(&got, line, len);
+				if(gotResult != expectedResult || (gotResult == LEX_OK && !sameTokens(&expected, &got)))
+				{
+					fprintf(stderr, "lexer check: %s scanner differs from scalar on \"%s\"\n", vectors[v].name, line);
+					mismatches++;
+				}
+			}
+		}
+	}
+
+	scan = saved;
+	freeTokens(&expected);
+	freeTokens(&got);
+	return mismatches;
+}
@@ -0,0 +1,58 @@
+/*
+ * LEXER HEADER FILE
+ *
+ * Splits a command line into words and operators
+ * Handles single quotes, double quotes, backslash escapes and $$
+ * Delimiters and quote characters are found with SSE2/AVX2 when
+ * available, with a scalar fallback
+ *
+ * Exit Error 20 indicates error with malloc
+ * */
+
+#ifndef LEXER_H
+#define LEXER_H
+
+// Header files
+#include <stdio.h>
+#include <stdlib.h>
+
+// Token types
+#define TOK_WORD 0				// Word, with quotes and escapes removed
+#define TOK_LT 1				// <
+#define TOK_GT 2				// >
+#define TOK_GTGT 3				// >>
+#define TOK_AMP 4				// &
+#define TOK_PIPE 5				// |
+
+// Lexer errors
+#define LEX_OK 0
+#define LEX_UNTERMINATED 1		// Quote never closed
+
+// Token Struct
+struct Token
+{
+	int type;					// TOK_* type
+	char * text;				// Word text, or operator as written
+	int quoted;					// True if any part of word was quoted or escaped
+};
+
+// Token List Struct
+// Token text is stored back to back in one buffer
+struct TokenList
+{
+	struct Token * tokens;		// Array of tokens
+	int count;					// Number of tokens
+	int capacity;				// Space in tokens array
+	char * store;				// Text of all tokens
+	size_t storeUsed;			// Bytes of store used
+	size_t storeSize;			// Bytes of store allocated
+};
+
+// Function Prototypes
+void initLexer(void);												// Pick scanner, done once
+void initTokens(struct TokenList * list);							// Initialize empty list
+int lexLine(struct TokenList * list, const char * line, size_t len);	// Split line into list
+void freeTokens(struct TokenList * list);							// Free memory when done
+int checkScanners(void);											// Compare vector scanners with scalar, returns mismatches
+
+#endif
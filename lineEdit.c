@@ -0,0 +1,591 @@
+/*
+ * LINE EDITOR IMPLEMENTATION FILE
+ *
+ * Raw-mode line editing for interactive shells
+ * Only the part of the line that changed is redrawn
+ * */
+
+// Header files
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <termios.h>
+#include "lineEdit.h"
+#include "complete.h"
+#include "history.h"
+#include "eventLoop.h"
+
+// Constants
+#ifndef EDIT_MAX
+#define EDIT_MAX 4096
+#endif
+
+// Most matches listed on a double tab
+#define EDIT_LIST_MAX 200
+
+// Key codes
+#define KEY_CTRL(key) ((key) & 0x1f)
+#define KEY_ESC 27
+#define KEY_BACKSPACE 127
+
+// Line being edited, kept across interruptions
+static char buf[EDIT_MAX];
+static size_t len = 0;
+static size_t pos = 0;
+
+// What's on screen after the prompt
+static char shown[EDIT_MAX];
+static size_t shownLen = 0;
+static size_t shownPos = 0;
+
+// History browsing, 0 when on the line being typed
+static long histIndex = 0;
+static char draft[EDIT_MAX];
+
+// Was last key a tab, for listing matches on a second tab
+static int lastWasTab = 0;
+
+// Prompt, for full redraws
+static const char * curPrompt = "";
+
+// Terminal output is gathered and written at once
+static char termBuf[EDIT_MAX * 2 + 64];
+static size_t termUsed = 0;
+
+/******************************** TERMINAL FUNCTIONS *********************************************/
+
+/*
+ * WRITE ALL OF TEXT
+ * Retries short writes and signal interruptions
+ * */
+static void termWrite(const char * text, size_t count)
+{
+	size_t done = 0;
+	ssize_t written = 0;
+
+	while(done < count)
+	{
+		written = write(STDOUT_FILENO, text + done, count - done);
+		if(written == -1)
+		{
+			if(errno == EINTR)
+				continue;
+			break;
+		}
+		done += written;
+	}
+}
+
+/*
+ * WRITE GATHERED OUTPUT
+ * */
+static void termFlush(void)
+{
+	termWrite(termBuf, termUsed);
+	termUsed = 0;
+}
+
+/*
+ * GATHER OUTPUT
+ * */
+static void termAppend(const char * text, size_t count)
+{
+	if(count > sizeof(termBuf) - termUsed)
+		termFlush();
+	if(count > sizeof(termBuf))
+	{
+		termWrite(text, count);
+		return;
+	}
+	memcpy(termBuf + termUsed, text, count);
+	termUsed += count;
+}
+
+/*
+ * MOVE CURSOR LEFT
+ * */
+static void cursorLeft(size_t count)
+{
+	char seq[32];
+
+	if(count > 0)
+		termAppend(seq, snprintf(seq, sizeof(seq), "\x1b[%zuD", count));
+}
+
+/*
+ * REDRAW CHANGED PART OF LINE
+ * Finds first difference with what's on screen and rewrites from there
+ * */
+static void refresh(void)
+{
+	size_t same = 0;
+
+	while(same < len && same < shownLen && buf[same] == shown[same])
+		same++;
+
+	// Only the cursor moved
+	if(same == len && len == shownLen)
+	{
+		if(pos < shownPos)
+			cursorLeft(shownPos - pos);
+		else if(pos > shownPos)
+			termAppend(buf + shownPos, pos - shownPos);
+	}
+	else
+	{
+		// Get to first difference
+		if(shownPos > same)
+			cursorLeft(shownPos - same);
+		else if(shownPos < same)
+			termAppend(buf + shownPos, same - shownPos);
+
+		// Rewrite rest, clearing anything left over
+		termAppend(buf + same, len - same);
+		if(shownLen > len)
+			termAppend("\x1b[K", 3);
+		cursorLeft(len - pos);
+	}
+
+	memcpy(shown, buf, len);
+	shownLen = len;
+	shownPos = pos;
+	termFlush();
+}
+
+/*
+ * REDRAW PROMPT AND WHOLE LINE
+ * */
+static void redrawAll(void)
+{
+	termAppend("\r", 1);
+	termAppend(curPrompt, strlen(curPrompt));
+	termAppend("\x1b[K", 3);
+	shownLen = 0;
+	shownPos = 0;
+	refresh();
+}
+
+/******************************** EDITING FUNCTIONS *********************************************/
+
+/*
+ * INSERT TEXT AT CURSOR
+ * */
+static void insertText(const char * text, size_t count)
+{
+	if(len + count >= EDIT_MAX)
+		return;
+
+	memmove(buf + pos + count, buf + pos, len - pos);
+	memcpy(buf + pos, text, count);
+	len += count;
+	pos += count;
+}
+
+/*
+ * DELETE TEXT
+ * */
+static void deleteText(size_t start, size_t count)
+{
+	memmove(buf + start, buf + start + count, len - start - count);
+	len -= count;
+	if(pos > start + count)
+		pos -= count;
+	else if(pos > start)
+		pos = start;
+}
+
+/*
+ * LOAD HISTORY ENTRY INTO LINE
+ * Entry 0 is the line being typed before browsing started
+ * */
+static void loadHistory(long index)
+{
+	long count = getHistoryCount();
+
+	if(index < 0 || index > count)
+		return;
+
+	// Save what was being typed when starting to browse
+	if(histIndex == 0)
+	{
+		memcpy(draft, buf, len);
+		draft[len] = '\0';
+	}
+
+	if(index == 0)
+		strcpy(buf, draft);
+	else if(getHistory(count - index + 1, buf, EDIT_MAX) == -1)
+		return;
+
+	histIndex = index;
+	len = strlen(buf);
+	pos = len;
+}
+
+/*
+ * LIST MATCHES BELOW LINE
+ * */
+static void listMatches(struct Matches * matches)
+{
+	char more[64];
+	int i = 0;
+
+	termAppend("\r\n", 2);
+	for(i = 0; i < matches->count && i < EDIT_LIST_MAX; i++)
+	{
+		termAppend(matches->items[i], strlen(matches->items[i]));
+		termAppend("  ", 2);
+	}
+	if(matches->count > EDIT_LIST_MAX)
+		termAppend(more, snprintf(more, sizeof(more), "... %d more", matches->count - EDIT_LIST_MAX));
+	termAppend("\r\n", 2);
+
+	redrawAll();
+}
+
+/*
+ * FIND WORD BEING COMPLETED
+ * Follows the lexer's quoting rules, so raw gets the word as the
+ * command will see it
+ * Returns where the word starts in buf
+ * */
+static size_t findWord(char * raw)
+{
+	size_t start = 0;
+	size_t used = 0;
+	size_t i = 0;
+	char quote = 0;
+	char c;
+
+	for(i = 0; i < pos; i++)
+	{
+		c = buf[i];
+		if(quote == '\'')
+		{
+			if(c == '\'')
+				quote = 0;
+			else
+				raw[used++] = c;
+		}
+		else if(quote == '"')
+		{
+			// Backslash only escapes these inside double quotes
+			if(c == '"')
+				quote = 0;
+			else if(c == '\\' && i + 1 < pos && strchr("\"\\$", buf[i + 1]) != NULL)
+				raw[used++] = buf[++i];
+			else
+				raw[used++] = c;
+		}
+		else if(c == '\\')
+		{
+			if(i + 1 < pos)
+				raw[used++] = buf[++i];
+		}
+		else if(c == '\'' || c == '"')
+			quote = c;
+		else if(strchr(" \t<>&|", c) != NULL)
+		{
+			start = i + 1;
+			used = 0;
+		}
+		else
+			raw[used++] = c;
+	}
+
+	raw[used] = '\0';
+	return start;
+}
+
+/*
+ * QUOTE NAME FOR THE LEXER
+ * Backslash before anything it treats specially, newlines in single
+ * quotes since backslash-newline joins lines
+ * Returns length written to out, which needs room for 3 per character
+ * */
+static size_t quoteName(const char * name, size_t count, char * out)
+{
+	size_t used = 0;
+	size_t i = 0;
+
+	for(i = 0; i < count; i++)
+	{
+		if(name[i] == '\n')
+		{
+			memcpy(out + used, "'\n'", 3);
+			used += 3;
+			continue;
+		}
+		if(strchr(" \t'\"\\$<>&|", name[i]) != NULL)
+			out[used++] = '\\';
+		out[used++] = name[i];
+	}
+
+	return used;
+}
+
+/*
+ * TAB COMPLETION
+ * First word completes commands, others complete filenames
+ * */
+static void complete(int secondTab)
+{
+	char prefix[EDIT_MAX];
+	char quoted[EDIT_MAX * 3];
+	struct Matches matches;
+	size_t start = 0;
+	size_t i = 0;
+	size_t common = 0;
+	size_t quotedLen = 0;
+	int isCommand = 1;
+
+	// Find word being completed, without its quoting
+	start = findWord(prefix);
+
+	// Command if nothing before it and no path given
+	for(i = 0; i < start; i++)
+	{
+		if(buf[i] != ' ' && buf[i] != '\t')
+			isCommand = 0;
+	}
+	if(strchr(prefix, '/') != NULL)
+		isCommand = 0;
+
+	initMatches(&matches);
+	if(isCommand)
+		completeCommand(prefix, &matches);
+	else
+		completeFile(prefix, &matches);
+
+	if(matches.count == 0)
+		termAppend("\a", 1);
+	else
+	{
+		common = commonPrefixLen(&matches);
+		if(common > strlen(prefix))
+		{
+			// Word is rewritten quoted, so names with spaces stay one word
+			quotedLen = quoteName(matches.items[0], common, quoted);
+			if(len - (pos - start) + quotedLen + 1 >= EDIT_MAX)
+				termAppend("\a", 1);
+			else
+			{
+				deleteText(start, pos - start);
+				insertText(quoted, quotedLen);
+
+				// Finished word, unless it's a directory to keep going into
+				if(matches.count == 1 && matches.items[0][common - 1] != '/')
+					insertText(" ", 1);
+			}
+		}
+		else if(matches.count > 1 && secondTab)
+			listMatches(&matches);
+		else if(matches.count > 1)
+			termAppend("\a", 1);
+	}
+
+	freeMatches(&matches);
+	refresh();
+}
+
+/*
+ * READ ONE BYTE OF A SEQUENCE
+ * A job notice mid-sequence must not split the key
+ * */
+static int readSeqByte(char * c)
+{
+	ssize_t got = 0;
+
+	while((got = read(STDIN_FILENO, c, 1)) == -1 && errno == EINTR);
+
+	return got == 1;
+}
+
+/*
+ * READ ESCAPE SEQUENCE
+ * Returns the key it stands for as a control key, or 0
+ * */
+static int readEscape(void)
+{
+	char seq[3];
+
+	if(!readSeqByte(&seq[0]) || !readSeqByte(&seq[1]))
+		return 0;
+
+	if(seq[0] == '[' && seq[1] >= '0' && seq[1] <= '9')
+	{
+		if(!readSeqByte(&seq[2]) || seq[2] != '~')
+			return 0;
+		if(seq[1] == '3')
+			return KEY_CTRL('d');
+		if(seq[1] == '1' || seq[1] == '7')
+			return KEY_CTRL('a');
+		if(seq[1] == '4' || seq[1] == '8')
+			return KEY_CTRL('e');
+		return 0;
+	}
+
+	if(seq[0] == '[' || seq[0] == 'O')
+	{
+		switch(seq[1])
+		{
+			case 'A': return KEY_CTRL('p');
+			case 'B': return KEY_CTRL('n');
+			case 'C': return KEY_CTRL('f');
+			case 'D': return KEY_CTRL('b');
+			case 'H': return KEY_CTRL('a');
+			case 'F': return KEY_CTRL('e');
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * THROW AWAY KEPT LINE
+ * */
+void editDiscard(void)
+{
+	len = 0;
+	pos = 0;
+	shownLen = 0;
+	shownPos = 0;
+	histIndex = 0;
+	lastWasTab = 0;
+}
+
+/*
+ * READ LINE WITH EDITING
+ * If redraw is set, prompt and kept line are drawn first,
+ * otherwise they're assumed to still be on screen
+ * Line gets a trailing newline like getline()
+ * Returns line length, EDIT_INTERRUPTED or EDIT_EOF
+ * */
+int editLine(const char * promptStr, int redraw, char * line, size_t size)
+{
+	struct termios orig, raw;
+	int result = EDIT_INTERRUPTED;
+	int tab = 0;
+	char c;
+
+	curPrompt = promptStr;
+
+	// Raw mode, but keep signals for ^C and ^Z
+	if(tcgetattr(STDIN_FILENO, &orig) == -1)
+		return EDIT_EOF;
+	raw = orig;
+	raw.c_iflag &= ~(ICRNL | IXON);
+	raw.c_lflag &= ~(ICANON | ECHO | IEXTEN);
+	raw.c_cc[VMIN] = 1;
+	raw.c_cc[VTIME] = 0;
+	tcsetattr(STDIN_FILENO, TCSADRAIN, &raw);
+
+	if(redraw)
+		redrawAll();
+
+	while(1)
+	{
+		// Background output keeps being forwarded while waiting for keys
+		if(evWaitReadable(STDIN_FILENO) == -1 || read(STDIN_FILENO, &c, 1) != 1)
+		{
+			result = (errno == EINTR) ? EDIT_INTERRUPTED : EDIT_EOF;
+			break;
+		}
+
+		if(c == KEY_ESC)
+			c = readEscape();
+
+		tab = 0;
+		switch(c)
+		{
+			// Done, hand line over
+			case '\r':
+			case '\n':
+				if(len + 2 > size)
+					len = size - 2;
+				memcpy(line, buf, len);
+				line[len] = '\n';
+				line[len + 1] = '\0';
+				result = len + 1;
+				termAppend("\r\n", 2);
+				termFlush();
+				editDiscard();
+				break;
+			case KEY_CTRL('d'):
+				if(len == 0)
+				{
+					result = EDIT_EOF;
+					termAppend("\r\n", 2);
+					termFlush();
+					break;
+				}
+				if(pos < len)
+					deleteText(pos, 1);
+				break;
+			case KEY_BACKSPACE:
+			case KEY_CTRL('h'):
+				if(pos > 0)
+					deleteText(pos - 1, 1);
+				break;
+			case '\t':
+				complete(lastWasTab);
+				tab = 1;
+				break;
+			case KEY_CTRL('a'):
+				pos = 0;
+				break;
+			case KEY_CTRL('e'):
+				pos = len;
+				break;
+			case KEY_CTRL('b'):
+				if(pos > 0)
+					pos--;
+				break;
+			case KEY_CTRL('f'):
+				if(pos < len)
+					pos++;
+				break;
+			case KEY_CTRL('k'):
+				len = pos;
+				break;
+			case KEY_CTRL('u'):
+				deleteText(0, pos);
+				break;
+			case KEY_CTRL('w'):
+			{
+				size_t start = pos;
+				while(start > 0 && buf[start - 1] == ' ')
+					start--;
+				while(start > 0 && buf[start - 1] != ' ')
+					start--;
+				deleteText(start, pos - start);
+				break;
+			}
+			case KEY_CTRL('l'):
+				termAppend("\x1b[H\x1b[2J", 7);
+				redrawAll();
+				break;
+			case KEY_CTRL('p'):
+				loadHistory(histIndex + 1);
+				break;
+			case KEY_CTRL('n'):
+				loadHistory(histIndex - 1);
+				break;
+			default:
+				if((unsigned char)c >= ' ')
+					insertText(&c, 1);
+				break;
+		}
+
+		if(result != EDIT_INTERRUPTED)
+			break;
+
+		lastWasTab = tab;
+		refresh();
+	}
+
+	tcsetattr(STDIN_FILENO, TCSADRAIN, &orig);
+	return result;
+}
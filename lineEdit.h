@@ -0,0 +1,23 @@
+/*
+ * LINE EDITOR HEADER FILE
+ *
+ * Raw-mode line editing for interactive shells
+ * Only the part of the line that changed is redrawn
+ * */
+
+#ifndef LINE_EDIT_H
+#define LINE_EDIT_H
+
+// Header files
+#include <stdio.h>
+#include <stdlib.h>
+
+// editLine() results besides a line length
+#define EDIT_INTERRUPTED -1			// Signal arrived, line is kept for next call
+#define EDIT_EOF -2					// Ctrl-D on an empty line
+
+// Function Prototypes
+int editLine(const char * promptStr, int redraw, char * line, size_t size);	// Read line with editing
+void editDiscard(void);														// Throw away kept line
+
+#endif
@@ -6,6 +6,7 @@
 
 // Header Files
 #include "linkedList.h"
+#include "output.h"
 #include <stdlib.h>
 #include <stdio.h>
 
@@ -117,6 +118,7 @@ int getSize(struct LinkedList * list)
 
 /*
  * PRINT LIST CONTENTS
+ * Buffered, written all at once at the next flush
  * */
 void printList(struct LinkedList * list)
 {
@@ -126,14 +128,12 @@ void printList(struct LinkedList * list)
 	// Loop through next nodes
 	while(curNode != NULL)
 	{
-		printf("%d ", curNode->val);
-		fflush(stdout);
+		outPrintf("%d ", curNode->val);
 		curNode = curNode->next;
 	}
 
 	// Newline at end
-	printf("\n");
-	fflush(stdout);
+	outPrintf("\n");
 }
 
 /*
@@ -0,0 +1,509 @@
+/*
+ * MEMO IMPLEMENTATION FILE
+ *
+ * Result cache for deterministic commands
+ * "memo cmd args" hashes the command, the environment it depends on
+ * and its stdin file, and keeps the command's stdout and exit status
+ * on disk under that hash. A repeat run replays them without forking.
+ * */
+
+// Header files
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include "memo.h"
+#include "fanout.h"
+#include "output.h"
+
+// FNV-1a 64 bit
+#define FNV_OFFSET 14695981039346656037ULL
+#define FNV_PRIME 1099511628211ULL
+
+// Environment variables that can change a command's output
+static const char * memoEnvNames[] = { "PATH", "HOME", "LANG", "LC_ALL", "LC_CTYPE", "TZ", NULL };
+
+// Cache location and size
+static char memoDir[MEMO_PATH_SIZE - 64];		// Leaves room for file names
+static long memoMaxKb = MEMO_MAX_KB;
+
+// One cache entry, for eviction
+struct MemoEntry
+{
+	char name[32];
+	off_t size;
+	struct timespec used;
+};
+
+/*
+ * HASH BYTES
+ * */
+static uint64_t hashBytes(uint64_t hash, const void * data, size_t len)
+{
+	const unsigned char * bytes = data;
+	size_t i;
+
+	for(i = 0; i < len; i++)
+	{
+		hash ^= bytes[i];
+		hash *= FNV_PRIME;
+	}
+
+	return hash;
+}
+
+/*
+ * HASH STRING, INCLUDING ITS TERMINATOR
+ * So "ab" "c" and "a" "bc" hash differently
+ * */
+static uint64_t hashString(uint64_t hash, const char * str)
+{
+	return hashBytes(hash, str, strlen(str) + 1);
+}
+
+/*
+ * HASH STDIN FILE
+ * Small regular files are hashed by content, anything else by identity
+ * and modification time
+ * Returns -1 if the file can't be read
+ * */
+static int hashStdin(uint64_t * hash, char * file)
+{
+	struct stat info;
+	void * data = NULL;
+	int fd = open(file, O_RDONLY | O_CLOEXEC);
+
+	if(fd == -1)
+		return -1;
+
+	if(fstat(fd, &info) == -1)
+	{
+		close(fd);
+		return -1;
+	}
+
+	if(S_ISREG(info.st_mode) && info.st_size <= MEMO_HASH_LIMIT)
+	{
+		if(info.st_size > 0)
+		{
+			data = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+			if(data == MAP_FAILED)
+			{
+				close(fd);
+				return -1;
+			}
+			*hash = hashBytes(*hash, data, info.st_size);
+			munmap(data, info.st_size);
+		}
+		*hash = hashBytes(*hash, &info.st_size, sizeof(info.st_size));
+	}
+	else
+	{
+		*hash = hashBytes(*hash, &info.st_dev, sizeof(info.st_dev));
+		*hash = hashBytes(*hash, &info.st_ino, sizeof(info.st_ino));
+		*hash = hashBytes(*hash, &info.st_size, sizeof(info.st_size));
+		*hash = hashBytes(*hash, &info.st_mtim, sizeof(info.st_mtim));
+	}
+
+	close(fd);
+	return 0;
+}
+
+/*
+ * HASH COMMAND
+ * Covers args, working directory, environment and stdin
+ * Returns -1 if anything can't be read
+ * */
+static int hashCmd(struct Cmd * command, uint64_t * hash)
+{
+	char cwd[MEMO_PATH_SIZE];
+	char * val = NULL;
+	int i;
+
+	*hash = FNV_OFFSET;
+
+	for(i = 0; command->args[i] != NULL; i++)
+		*hash = hashString(*hash, command->args[i]);
+	*hash = hashString(*hash, "");
+
+	if(getcwd(cwd, sizeof(cwd)) == NULL)
+		return -1;
+	*hash = hashString(*hash, cwd);
+
+	// Unset and empty hash differently
+	for(i = 0; memoEnvNames[i] != NULL; i++)
+	{
+		val = getenv(memoEnvNames[i]);
+		*hash = hashBytes(*hash, &i, sizeof(i));
+		if(val != NULL)
+			*hash = hashString(*hash, val);
+	}
+
+	if(command->redirStdin)
+		return hashStdin(hash, command->stdinFile);
+
+	return 0;
+}
+
+/*
+ * MAKE DIRECTORY AND ANY MISSING PARENTS
+ * */
+static int makeDirs(char * path)
+{
+	char * slash = path;
+
+	while((slash = strchr(slash + 1, '/')) != NULL)
+	{
+		*slash = '\0';
+		if(mkdir(path, 0700) == -1 && errno != EEXIST)
+		{
+			*slash = '/';
+			return -1;
+		}
+		*slash = '/';
+	}
+
+	if(mkdir(path, 0700) == -1 && errno != EEXIST)
+		return -1;
+
+	return 0;
+}
+
+/*
+ * GET CACHE DIRECTORY
+ * $XDG_CACHE_HOME/smallsh/memo, or ~/.cache/smallsh/memo
+ * Returns NULL if it can't be created
+ * */
+static char * getMemoDir(void)
+{
+	char * base = getenv("XDG_CACHE_HOME");
+	char * home = getenv("HOME");
+	int len;
+
+	if(memoDir[0] != '\0')
+		return memoDir;
+
+	if(base != NULL && base[0] != '\0')
+		len = snprintf(memoDir, sizeof(memoDir), "%s/%s", base, MEMO_DIR);
+	else if(home != NULL)
+		len = snprintf(memoDir, sizeof(memoDir), "%s/.cache/%s", home, MEMO_DIR);
+	else
+		return NULL;
+
+	if(len >= (int)sizeof(memoDir) || makeDirs(memoDir) == -1)
+	{
+		memoDir[0] = '\0';
+		return NULL;
+	}
+
+	return memoDir;
+}
+
+/*
+ * BUILD PATH OF CACHE FILE
+ * */
+static void memoPath(char * buf, uint64_t hash, const char * ext)
+{
+	snprintf(buf, MEMO_PATH_SIZE, "%s/%016llx.%s", memoDir, (unsigned long long)hash, ext);
+}
+
+/*
+ * REPLAY OUTPUT
+ * Copies to the redirected file, or the shell's stdout
+ * Returns -1 on error
+ * */
+static int replay(int in, int redirStdout, char * stdoutFile, int append)
+{
+	int out = STDOUT_FILENO;
+	int result = 0;
+
+	if(redirStdout)
+	{
+		out = openOutput(stdoutFile, append);
+		if(out == -1)
+		{
+			outPrintf("cannot open %s for output\n", stdoutFile);
+			return -1;
+		}
+	}
+	else
+		outFlush();
+
+	result = copyFd(in, out);
+
+	if(out != STDOUT_FILENO)
+		close(out);
+
+	return result;
+}
+
+/*
+ * READ CACHED EXIT STATUS
+ * Returns -1 if not cached
+ * */
+static int readStatus(uint64_t hash, int * exitMethod)
+{
+	char path[MEMO_PATH_SIZE];
+	FILE * file = NULL;
+	int result = -1;
+
+	memoPath(path, hash, "status");
+	file = fopen(path, "re");
+	if(file == NULL)
+		return -1;
+
+	if(fscanf(file, "%d", exitMethod) == 1)
+		result = 0;
+
+	fclose(file);
+	return result;
+}
+
+/*
+ * COMPARE ENTRIES BY LAST USE
+ * */
+static int olderEntry(const void * a, const void * b)
+{
+	const struct MemoEntry * left = a;
+	const struct MemoEntry * right = b;
+
+	if(left->used.tv_sec != right->used.tv_sec)
+		return (left->used.tv_sec < right->used.tv_sec) ? -1 : 1;
+	if(left->used.tv_nsec != right->used.tv_nsec)
+		return (left->used.tv_nsec < right->used.tv_nsec) ? -1 : 1;
+	return 0;
+}
+
+/*
+ * LIST CACHE ENTRIES
+ * Returns array to be freed, or NULL if empty or unreadable
+ * */
+static struct MemoEntry * listEntries(int * count, off_t * total)
+{
+	struct MemoEntry * entries = NULL;
+	struct dirent * ent = NULL;
+	struct stat info;
+	int cap = 0;
+	size_t len;
+	DIR * dir = opendir(memoDir);
+
+	*count = 0;
+	*total = 0;
+	if(dir == NULL)
+		return NULL;
+
+	while((ent = readdir(dir)) != NULL)
+	{
+		len = strlen(ent->d_name);
+		if(len < 4 || len >= sizeof(entries->name) || strcmp(ent->d_name + len - 4, ".out"))
+			continue;
+		if(fstatat(dirfd(dir), ent->d_name, &info, 0) == -1)
+			continue;
+
+		if(*count == cap)
+		{
+			cap = cap ? cap * 2 : 64;
+			entries = realloc(entries, cap * sizeof(struct MemoEntry));
+			if(entries == NULL) exit(20);
+		}
+
+		strcpy(entries[*count].name, ent->d_name);
+		entries[*count].size = info.st_size;
+		entries[*count].used = info.st_mtim;
+		*total += info.st_size;
+		(*count)++;
+	}
+
+	closedir(dir);
+	return entries;
+}
+
+/*
+ * REMOVE CACHE ENTRY
+ * */
+static void removeEntry(struct MemoEntry * entry)
+{
+	char path[MEMO_PATH_SIZE];
+	size_t len = strlen(entry->name) - 4;
+
+	snprintf(path, sizeof(path), "%s/%s", memoDir, entry->name);
+	unlink(path);
+	snprintf(path, sizeof(path), "%s/%.*s.status", memoDir, (int)len, entry->name);
+	unlink(path);
+}
+
+/*
+ * EVICT LEAST RECENTLY USED ENTRIES
+ * Until the cache fits in maxKb
+ * */
+static void evict(long maxKb)
+{
+	struct MemoEntry * entries = NULL;
+	int count = 0, i;
+	off_t total = 0;
+
+	entries = listEntries(&count, &total);
+	if(total > (off_t)maxKb * 1024)
+	{
+		qsort(entries, count, sizeof(struct MemoEntry), olderEntry);
+		for(i = 0; i < count && total > (off_t)maxKb * 1024; i++)
+		{
+			removeEntry(&entries[i]);
+			total -= entries[i].size;
+		}
+	}
+
+	free(entries);
+}
+
+/*
+ * START MEMO COMMAND
+ * On a cache hit, replays the output and sets exitMethod
+ * On a miss, points the command's stdout at a capture file
+ * */
+int memoStart(struct Cmd * command, struct Memo * memo, int * exitMethod)
+{
+	char path[MEMO_PATH_SIZE];
+	int fd = -1;
+
+	// Only one output can be replayed
+	if(needsFanout(command))
+		return MEMO_OFF;
+
+	if(getMemoDir() == NULL || hashCmd(command, &memo->hash) == -1)
+		return MEMO_OFF;
+
+	// Hit
+	memoPath(path, memo->hash, "out");
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if(fd != -1 && readStatus(memo->hash, exitMethod) == 0)
+	{
+		// Mark as recently used
+		futimens(fd, NULL);
+
+		if(replay(fd, command->redirStdout, command->stdoutFile, command->stdoutAppend) == -1)
+			*exitMethod = 1 << 8;
+		close(fd);
+		return MEMO_HIT;
+	}
+	if(fd != -1)
+		close(fd);
+
+	// Miss, capture output
+	snprintf(memo->tmpPath, sizeof(memo->tmpPath), "%s/%016llx.tmp%d",
+			memoDir, (unsigned long long)memo->hash, (int)getpid());
+	memo->tmpFd = open(memo->tmpPath, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+	if(memo->tmpFd == -1)
+		return MEMO_OFF;
+
+	memo->redirStdout = command->redirStdout;
+	memo->stdoutAppend = command->stdoutAppend;
+	strcpy(memo->stdoutFile, command->stdoutFile);
+	command->redirStdout = 0;
+	command->stdoutFd = memo->tmpFd;
+
+	return MEMO_MISS;
+}
+
+/*
+ * DROP MEMO CAPTURE
+ * Command never ran, so there's nothing to cache or replay
+ * */
+void memoCancel(struct Memo * memo)
+{
+	unlink(memo->tmpPath);
+	close(memo->tmpFd);
+}
+
+/*
+ * FINISH MEMO COMMAND
+ * Caches the output if the command exited normally, then replays it
+ * */
+void memoFinish(struct Memo * memo, int exitMethod)
+{
+	char path[MEMO_PATH_SIZE];
+	FILE * file = NULL;
+	int stored = 0;
+
+	// Status goes in first, output being present marks entry complete
+	if(WIFEXITED(exitMethod))
+	{
+		memoPath(path, memo->hash, "status");
+		file = fopen(path, "we");
+		if(file != NULL)
+		{
+			fprintf(file, "%d\n", exitMethod);
+			if(fclose(file) == 0)
+			{
+				memoPath(path, memo->hash, "out");
+				stored = (rename(memo->tmpPath, path) == 0);
+			}
+		}
+	}
+	if(!stored)
+		unlink(memo->tmpPath);
+
+	lseek(memo->tmpFd, 0, SEEK_SET);
+	replay(memo->tmpFd, memo->redirStdout, memo->stdoutFile, memo->stdoutAppend);
+	close(memo->tmpFd);
+
+	if(stored)
+		evict(memoMaxKb);
+}
+
+/*
+ * MEMO BUILTIN
+ * memo             show cache usage
+ * memo -s KB       set max cache size
+ * memo -c          clear cache
+ * */
+void memoBuiltin(char ** args)
+{
+	struct MemoEntry * entries = NULL;
+	int count = 0;
+	off_t total = 0;
+	char * end = NULL;
+	long val;
+
+	if(getMemoDir() == NULL)
+	{
+		outPrintf("memo: no cache directory\n");
+		return;
+	}
+
+	if(args[1] == NULL)
+	{
+		entries = listEntries(&count, &total);
+		free(entries);
+		outPrintf("memo: %d entries, %ld of %ld KB in %s\n",
+				count, (long)((total + 1023) / 1024), memoMaxKb, memoDir);
+		return;
+	}
+
+	if(!strcmp("-c", args[1]))
+	{
+		evict(0);
+		return;
+	}
+
+	if(!strcmp("-s", args[1]) && args[2] != NULL)
+	{
+		val = strtol(args[2], &end, 10);
+		if(*end != '\0' || end == args[2] || val < 0)
+		{
+			outPrintf("memo: invalid size %s\n", args[2]);
+			return;
+		}
+		memoMaxKb = val;
+		evict(memoMaxKb);
+		return;
+	}
+
+	outPrintf("memo: unknown option %s\n", args[1]);
+}
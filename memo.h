@@ -0,0 +1,57 @@
+/*
+ * MEMO HEADER FILE
+ *
+ * Result cache for deterministic commands
+ * "memo cmd args" hashes the command, the environment it depends on
+ * and its stdin file, and keeps the command's stdout and exit status
+ * on disk under that hash. A repeat run replays them without forking.
+ * */
+
+#ifndef MEMO_H
+#define MEMO_H
+
+// Header files
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include "cmd.h"
+
+// Constants
+#ifndef MEMO_DIR
+#define MEMO_DIR "smallsh/memo"
+#endif
+
+#ifndef MEMO_MAX_KB
+#define MEMO_MAX_KB 65536
+#endif
+
+// Stdin files bigger than this are keyed by size and mtime, not content
+#ifndef MEMO_HASH_LIMIT
+#define MEMO_HASH_LIMIT (16 * 1024 * 1024)
+#endif
+
+#define MEMO_PATH_SIZE 4096
+
+// Results of memoStart()
+#define MEMO_OFF 0				// Cache not usable, run command as normal
+#define MEMO_HIT 1				// Result replayed, don't run command
+#define MEMO_MISS 2				// Command's stdout now goes to cache
+
+// In-progress cache entry
+struct Memo
+{
+	uint64_t hash;									// Key of command
+	int tmpFd;										// Output being captured
+	char tmpPath[MEMO_PATH_SIZE];					// Where it's captured
+	int redirStdout;								// Command's own stdout redirect
+	char stdoutFile[WORD_SIZE];						// Filename of it
+	int stdoutAppend;								// Redirect was >>
+};
+
+// Function prototypes
+int memoStart(struct Cmd * command, struct Memo * memo, int * exitMethod);	// Replay or start capture
+void memoFinish(struct Memo * memo, int exitMethod);					// Store and replay capture
+void memoCancel(struct Memo * memo);									// Drop capture, command never ran
+void memoBuiltin(char ** args);											// memo builtin options
+
+#endif
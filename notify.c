@@ -0,0 +1,269 @@
+/*
+ * NOTIFY IMPLEMENTATION FILE
+ *
+ * Completion notices for background processes, and the table
+ * of finished background processes
+ * */
+
+// Header files
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include "notify.h"
+#include "status.h"
+#include "sigHandlers.h"
+#include "output.h"
+
+// Current mode and summary interval
+static int notifyMode = NOTIFY_PROMPT;
+static int summaryInterval = 10;
+
+// Summary counts since last summary
+static int summaryDone = 0;
+static int summaryFailed = 0;
+static time_t lastSummary = 0;
+
+// Ring of most recently finished processes
+static struct DoneJob doneTable[DONE_TABLE_SIZE];
+static int doneNext = 0;
+static int doneCount = 0;
+
+// Notices printed while the prompt was interrupted need their own line
+static int asyncActive = 0;
+static int asyncPrinted = 0;
+
+// Names of modes, indexed by mode number
+static const char * modeNames[] = { "prompt", "immediate", "summary", "silent" };
+
+/*
+ * START NOTICE
+ * Moves off the prompt line for the first notice while at the prompt
+ * */
+static void startNotice(void)
+{
+	if(asyncActive && !asyncPrinted)
+		outPuts("\n");
+	asyncPrinted = asyncActive;
+}
+
+/*
+ * RECORD FINISHED BACKGROUND PROCESS
+ * */
+void notifyJobDone(pid_t pid, int childExitMethod)
+{
+	struct Status status;
+
+	// Add to done table, overwriting oldest
+	doneTable[doneNext].pid = pid;
+	doneTable[doneNext].childExitMethod = childExitMethod;
+	doneNext = (doneNext + 1) % DONE_TABLE_SIZE;
+	if(doneCount < DONE_TABLE_SIZE)
+		doneCount++;
+
+	initStatus(&status);
+	changeStatus(&status, childExitMethod);
+
+	switch(notifyMode)
+	{
+		case NOTIFY_PROMPT:
+		case NOTIFY_IMMEDIATE:
+			startNotice();
+			outPrintf("background pid %d is done: ", (int)pid);
+			printStatus(&status);
+			break;
+		case NOTIFY_SUMMARY:
+			summaryDone++;
+			if(wasSignalTerm(&status) || status.value != 0)
+				summaryFailed++;
+			break;
+		case NOTIFY_SILENT:
+			break;
+	}
+}
+
+/*
+ * PRINT SUMMARY IF DUE
+ * If one is waiting but not due yet, set an alarm for when it is
+ * */
+void notifyFlush(void)
+{
+	time_t now;
+
+	if(notifyMode != NOTIFY_SUMMARY || summaryDone == 0)
+		return;
+
+	now = time(NULL);
+	if(now - lastSummary < summaryInterval)
+	{
+		alarm(summaryInterval - (now - lastSummary));
+		return;
+	}
+
+	startNotice();
+	outPrintf("%d job%s done, %d failed\n", summaryDone, summaryDone == 1 ? "" : "s", summaryFailed);
+	summaryDone = 0;
+	summaryFailed = 0;
+	lastSummary = now;
+}
+
+/*
+ * SHOULD NOTICES INTERRUPT THE PROMPT
+ * */
+int notifyIsAsync(void)
+{
+	return (notifyMode == NOTIFY_IMMEDIATE || notifyMode == NOTIFY_SUMMARY);
+}
+
+/*
+ * START OF NOTICES WHILE AT PROMPT
+ * */
+void notifyBeginAsync(void)
+{
+	asyncActive = 1;
+	asyncPrinted = 0;
+}
+
+/*
+ * END OF NOTICES WHILE AT PROMPT
+ * Returns true if anything was printed, so the prompt needs redrawing
+ * */
+int notifyEndAsync(void)
+{
+	int printed = asyncPrinted;
+
+	asyncActive = 0;
+	asyncPrinted = 0;
+	return printed;
+}
+
+/*
+ * PRINT DONE TABLE
+ * Oldest first
+ * */
+void printDoneJobs(void)
+{
+	int i = 0;
+	int index = 0;
+	struct Status status;
+
+	for(i = 0; i < doneCount; i++)
+	{
+		index = (doneNext - doneCount + i + DONE_TABLE_SIZE) % DONE_TABLE_SIZE;
+
+		initStatus(&status);
+		changeStatus(&status, doneTable[index].childExitMethod);
+		outPrintf("done %d: ", (int)doneTable[index].pid);
+		printStatus(&status);
+	}
+}
+
+/*
+ * EMPTY DONE TABLE
+ * */
+void clearDoneJobs(void)
+{
+	doneNext = 0;
+	doneCount = 0;
+}
+
+/*
+ * SET SIGNAL HANDLERS FOR MODE
+ * Async modes need SIGCHLD and SIGALRM to interrupt the prompt,
+ * other modes only need SIGCHLD to wake the event loop
+ * */
+static void setNotifySignals(void)
+{
+	struct sigaction SIGCHLD_action = {0};
+	struct sigaction SIGALRM_action = {0};
+
+	if(notifyIsAsync())
+	{
+		// No SA_RESTART, so getline() returns at the prompt
+		// Blocking copies (copyFd()) retry on EINTR themselves
+		SIGCHLD_action.sa_handler = catchNotify;
+		SIGALRM_action.sa_handler = catchNotify;
+	}
+	else
+	{
+		// Restarted, so only event loop waits see it
+		SIGCHLD_action.sa_handler = catchChild;
+		SIGCHLD_action.sa_flags = SA_RESTART;
+		SIGALRM_action.sa_handler = SIG_DFL;
+		alarm(0);
+	}
+
+	sigfillset(&SIGCHLD_action.sa_mask);
+	sigaction(SIGCHLD, &SIGCHLD_action, NULL);
+	sigfillset(&SIGALRM_action.sa_mask);
+	sigaction(SIGALRM, &SIGALRM_action, NULL);
+}
+
+/*
+ * INITIALIZE NOTICES
+ * */
+void initNotify(void)
+{
+	setNotifySignals();
+}
+
+/*
+ * NOTIFY BUILTIN
+ * notify                       show mode
+ * notify prompt                notices before next prompt (default)
+ * notify immediate             notices as soon as processes finish (also set -b)
+ * notify summary [SECONDS]     one summary line per interval
+ * notify silent                only record in done table, see jobs
+ * */
+void notifyBuiltin(char ** args)
+{
+	int i = 0;
+	int mode = -1;
+	char * end = NULL;
+	long interval;
+
+	// No args, show current mode
+	if(args[1] == NULL)
+	{
+		if(notifyMode == NOTIFY_SUMMARY)
+			outPrintf("notify summary %d\n", summaryInterval);
+		else
+			outPrintf("notify %s\n", modeNames[notifyMode]);
+		return;
+	}
+
+	for(i = 0; i < 4; i++)
+	{
+		if(!strcmp(modeNames[i], args[1]))
+			mode = i;
+	}
+	if(mode == -1)
+	{
+		outPrintf("notify: unknown mode %s\n", args[1]);
+		return;
+	}
+
+	// Summary interval
+	if(mode == NOTIFY_SUMMARY && args[2] != NULL)
+	{
+		interval = strtol(args[2], &end, 10);
+		if(*end != '\0' || end == args[2] || interval < 0)
+		{
+			outPrintf("notify: invalid interval %s\n", args[2]);
+			return;
+		}
+		summaryInterval = (int)interval;
+	}
+
+	// Anything counted so far is shown when leaving summary mode
+	if(notifyMode == NOTIFY_SUMMARY && mode != NOTIFY_SUMMARY)
+	{
+		lastSummary = 0;
+		notifyFlush();
+	}
+
+	notifyMode = mode;
+	setNotifySignals();
+}
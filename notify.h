@@ -0,0 +1,45 @@
+/*
+ * NOTIFY HEADER FILE
+ *
+ * Completion notices for background processes, and the table
+ * of finished background processes
+ * */
+
+#ifndef NOTIFY_H
+#define NOTIFY_H
+
+// Header files
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+// Notify modes
+#define NOTIFY_PROMPT 0			// Print each notice before the next prompt
+#define NOTIFY_IMMEDIATE 1		// Print each notice as soon as it happens, while at the prompt
+#define NOTIFY_SUMMARY 2		// Print one summary line per interval
+#define NOTIFY_SILENT 3			// Only record in the done table
+
+// Number of finished processes remembered
+#ifndef DONE_TABLE_SIZE
+#define DONE_TABLE_SIZE 64
+#endif
+
+// Finished Process Struct
+struct DoneJob
+{
+	pid_t pid;						// Process id
+	int childExitMethod;			// Status from waitpid()
+};
+
+// Function prototypes
+void initNotify(void);									// Set signal handlers for default mode
+void notifyJobDone(pid_t pid, int childExitMethod);		// Record a finished bg process
+void notifyFlush(void);									// Print summary if one is due
+int notifyIsAsync(void);								// Should notices interrupt the prompt
+void notifyBeginAsync(void);							// Start of notices while at prompt
+int notifyEndAsync(void);								// End of notices, returns true if any printed
+void printDoneJobs(void);								// Print done table
+void clearDoneJobs(void);								// Empty done table
+void notifyBuiltin(char ** args);						// notify builtin
+
+#endif
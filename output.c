@@ -0,0 +1,188 @@
+/*
+ * OUTPUT IMPLEMENTATION FILE
+ *
+ * Buffered writer for shell messages
+ * Messages are gathered and written with a single writev()
+ * when outFlush() is called (before the prompt, before fork, at exit)
+ * */
+
+// Header files
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/uio.h>
+#include "output.h"
+
+// Formatted messages are stored in buf, and iov holds the pieces to write
+// Signal handlers never touch these, they use outWriteNow() instead
+static char buf[OUT_BUF_SIZE];
+static size_t bufUsed = 0;
+static struct iovec iov[OUT_MAX_IOV];
+static int iovCount = 0;
+
+// Is the flush registered to run at exit
+static int atExitSet = 0;
+
+/*
+ * WRITE ALL IOVECS
+ * Handles partial writes and signal interrupts
+ * */
+static void writeAll(struct iovec * vec, int count)
+{
+	ssize_t written = 0;
+
+	while(count > 0)
+	{
+		written = writev(STDOUT_FILENO, vec, count);
+		if(written == -1)
+		{
+			if(errno == EINTR)
+				continue;
+			return;
+		}
+
+		// Skip past everything written
+		while(count > 0 && (size_t)written >= vec->iov_len)
+		{
+			written -= vec->iov_len;
+			vec++;
+			count--;
+		}
+		if(count > 0)
+		{
+			vec->iov_base = (char *)vec->iov_base + written;
+			vec->iov_len -= written;
+		}
+	}
+}
+
+/*
+ * ADD PIECE TO QUEUE
+ * Pieces that are contiguous with the last one are merged
+ * */
+static void addIov(const char * start, size_t len)
+{
+	// Make sure everything queued is written before the process exits
+	if(!atExitSet)
+	{
+		atexit(outFlush);
+		atExitSet = 1;
+	}
+
+	if(iovCount > 0 && (char *)iov[iovCount-1].iov_base + iov[iovCount-1].iov_len == start)
+	{
+		iov[iovCount-1].iov_len += len;
+		return;
+	}
+
+	if(iovCount == OUT_MAX_IOV)
+		outFlush();
+
+	iov[iovCount].iov_base = (void *)start;
+	iov[iovCount].iov_len = len;
+	iovCount++;
+}
+
+/*
+ * FORMAT MESSAGE INTO BUFFER
+ * */
+void outPrintf(const char * format, ...)
+{
+	va_list args;
+	int len = 0;
+	char * bigBuf = NULL;
+
+	// Make sure adding this can't force a flush after formatting
+	if(iovCount == OUT_MAX_IOV)
+		outFlush();
+
+	// Try to fit in space left
+	va_start(args, format);
+	len = vsnprintf(buf + bufUsed, OUT_BUF_SIZE - bufUsed, format, args);
+	va_end(args);
+	if(len < 0)
+		return;
+
+	// Didn't fit, make room and try again
+	if((size_t)len >= OUT_BUF_SIZE - bufUsed)
+	{
+		outFlush();
+
+		// Too big for buffer at all, write it on its own
+		if((size_t)len >= OUT_BUF_SIZE)
+		{
+			bigBuf = malloc(len + 1);
+			if(bigBuf == NULL) exit(20);
+
+			va_start(args, format);
+			vsnprintf(bigBuf, len + 1, format, args);
+			va_end(args);
+
+			struct iovec big = { bigBuf, len };
+			writeAll(&big, 1);
+			free(bigBuf);
+			return;
+		}
+
+		va_start(args, format);
+		vsnprintf(buf, OUT_BUF_SIZE, format, args);
+		va_end(args);
+	}
+
+	addIov(buf + bufUsed, len);
+	bufUsed += len;
+}
+
+/*
+ * QUEUE STRING LITERAL
+ * String must stay valid until flushed, so only for literals
+ * */
+void outPuts(const char * literal)
+{
+	addIov(literal, strlen(literal));
+}
+
+/*
+ * WRITE EVERYTHING QUEUED
+ * */
+void outFlush(void)
+{
+	if(iovCount > 0)
+		writeAll(iov, iovCount);
+
+	iovCount = 0;
+	bufUsed = 0;
+}
+
+/*
+ * WRITE MESSAGE IMMEDIATELY
+ * Only uses async-signal-safe calls, for signal handlers
+ * */
+void outWriteNow(const char * msg)
+{
+	size_t len = 0;
+	ssize_t written = 0;
+	int savedErrno = errno;
+
+	while(msg[len] != '\0')
+		len++;
+
+	while(len > 0)
+	{
+		written = write(STDOUT_FILENO, msg, len);
+		if(written == -1)
+		{
+			if(errno == EINTR)
+				continue;
+			break;
+		}
+		msg += written;
+		len -= written;
+	}
+
+	// Don't disturb errno for the code that was interrupted
+	errno = savedErrno;
+}
@@ -0,0 +1,31 @@
+/*
+ * OUTPUT HEADER FILE
+ *
+ * Buffered writer for shell messages
+ * Messages are gathered and written with a single writev()
+ * when outFlush() is called (before the prompt, before fork, at exit)
+ * */
+
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+// Header files
+#include <stdio.h>
+#include <stdlib.h>
+
+// Constants
+#ifndef OUT_BUF_SIZE
+#define OUT_BUF_SIZE 8192
+#endif
+
+#ifndef OUT_MAX_IOV
+#define OUT_MAX_IOV 64
+#endif
+
+// Function Prototypes
+void outPrintf(const char * format, ...);		// Format message into buffer
+void outPuts(const char * literal);				// Queue a string literal without copying
+void outFlush(void);							// Write everything queued
+void outWriteNow(const char * msg);				// Unbuffered, async-signal-safe write
+
+#endif
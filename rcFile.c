@@ -0,0 +1,401 @@
+/*
+ * RC FILE IMPLEMENTATION FILE
+ *
+ * Startup commands from ~/.smallshrc
+ * The parsed commands are kept in a snapshot file next to the rc file,
+ * and rebuilt only when the rc file changes. Startup just maps the
+ * snapshot; each command is unpacked when it's about to run.
+ *
+ * Snapshot layout: a header identifying the rc file it was built from,
+ * then one record per command. A record is a kind byte, and then either
+ * the raw line, or the parsed command's flags and strings.
+ *
+ * Exit Error 5 indicates error with malloc
+ * */
+
+// Header files
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include "rcFile.h"
+#include "output.h"
+
+// Bump when the layout changes
+#define RC_MAGIC "SSHRC\0\0\1"
+
+// Record kinds
+#define RC_PARSED 1				// Parsed command follows
+#define RC_RAW 2				// Line to parse when run
+
+// Parsed command flags
+#define RC_BG 0x01
+#define RC_STDIN 0x02
+#define RC_STDOUT 0x04
+#define RC_APPEND 0x08
+#define RC_TEE_STDOUT 0x10
+
+// Snapshot header
+struct RcHeader
+{
+	char magic[8];
+	int64_t mtimeSec;			// rc file it was built from
+	int64_t mtimeNsec;
+	int64_t size;
+	uint64_t inode;
+};
+
+// Global foreground mode
+extern unsigned int fgMode;
+
+// Snapshot, mapped or built in memory
+static char * snap = NULL;
+static size_t snapSize = 0;
+static int snapMapped = 0;
+static size_t cursor = 0;
+static char snapPath[4096 + 8];
+
+// Snapshot being built
+static size_t buildCap = 0;
+
+/*
+ * APPEND BYTES TO SNAPSHOT BEING BUILT
+ * */
+static void put(const void * data, size_t len)
+{
+	while(snapSize + len > buildCap)
+	{
+		buildCap = buildCap ? buildCap * 2 : 4096;
+		snap = realloc(snap, buildCap);
+		if(snap == NULL) exit(5);
+	}
+
+	memcpy(snap + snapSize, data, len);
+	snapSize += len;
+}
+
+/*
+ * APPEND STRING, INCLUDING TERMINATOR
+ * */
+static void putString(const char * str)
+{
+	put(str, strlen(str) + 1);
+}
+
+/*
+ * APPEND ONE RC LINE
+ * Lines whose parse depends on the running shell ($$), and lines with
+ * syntax errors, are kept raw and parsed when run
+ * */
+static void putLine(char * line)
+{
+	struct Cmd command;
+	unsigned char kind = RC_RAW;
+	unsigned char flags = 0;
+	unsigned char numTee = 0;
+	unsigned char teeAppend = 0;
+	uint16_t numArgs = 0;
+	int i;
+
+	initCmd(&command);
+	if(strstr(line, "$$") == NULL && parseCmdQuiet(&command, line) == NULL)
+		kind = RC_PARSED;
+
+	// Blank or comment
+	if(kind == RC_PARSED && (command.args[0] == NULL || command.args[0][0] == '#'))
+	{
+		destroyCmd(&command);
+		return;
+	}
+
+	put(&kind, 1);
+	if(kind == RC_RAW)
+	{
+		putString(line);
+		if(command.args != NULL)
+			destroyCmd(&command);
+		return;
+	}
+
+	flags = (command.bgProc ? RC_BG : 0) | (command.redirStdin ? RC_STDIN : 0)
+		| (command.redirStdout ? RC_STDOUT : 0) | (command.stdoutAppend ? RC_APPEND : 0)
+		| (command.teeStdout ? RC_TEE_STDOUT : 0);
+	for(i = 0; i < command.numTee; i++)
+		teeAppend |= command.teeAppend[i] << i;
+	numTee = command.numTee;
+	numArgs = command.numArgs;
+
+	put(&flags, 1);
+	put(&numTee, 1);
+	put(&teeAppend, 1);
+	put(&numArgs, sizeof(numArgs));
+	putString(command.stdinFile);
+	putString(command.stdoutFile);
+	for(i = 0; i < command.numTee; i++)
+		putString(command.teeFile[i]);
+	for(i = 0; i < command.numArgs; i++)
+		putString(command.args[i]);
+
+	destroyCmd(&command);
+}
+
+/*
+ * BUILD SNAPSHOT FROM RC FILE
+ * Returns -1 if rc file can't be read
+ * */
+static int buildSnap(char * rcPath, struct RcHeader * header)
+{
+	FILE * rc = fopen(rcPath, "r");
+	char * line = NULL;
+	size_t size = 0;
+
+	if(rc == NULL)
+		return -1;
+
+	put(header, sizeof(struct RcHeader));
+	while(getline(&line, &size, rc) != -1)
+		putLine(line);
+
+	free(line);
+	fclose(rc);
+	return 0;
+}
+
+/*
+ * SAVE SNAPSHOT
+ * Written to a temporary file then renamed, so readers never see half
+ * Failing is fine, it's rebuilt next time
+ * */
+static void saveSnap(void)
+{
+	char tmpPath[4096 + 32];
+	int fd;
+
+	snprintf(tmpPath, sizeof(tmpPath), "%s.tmp%d", snapPath, (int)getpid());
+	fd = open(tmpPath, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+	if(fd == -1)
+		return;
+
+	if(write(fd, snap, snapSize) != (ssize_t)snapSize || close(fd) == -1
+			|| rename(tmpPath, snapPath) == -1)
+		unlink(tmpPath);
+}
+
+/*
+ * MAP SNAPSHOT IF IT MATCHES RC FILE
+ * Returns -1 if it's missing or out of date
+ * */
+static int mapSnap(struct RcHeader * header)
+{
+	struct stat info;
+	int fd = open(snapPath, O_RDONLY | O_CLOEXEC);
+
+	if(fd == -1)
+		return -1;
+
+	if(fstat(fd, &info) == -1 || info.st_size < (off_t)sizeof(struct RcHeader))
+	{
+		close(fd);
+		return -1;
+	}
+
+	snap = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if(snap == MAP_FAILED)
+	{
+		snap = NULL;
+		return -1;
+	}
+
+	if(memcmp(snap, header, sizeof(struct RcHeader)))
+	{
+		munmap(snap, info.st_size);
+		snap = NULL;
+		return -1;
+	}
+
+	snapSize = info.st_size;
+	snapMapped = 1;
+	return 0;
+}
+
+/*
+ * INITIALIZE RC FILE
+ * $SMALLSHRC, or ~/.smallshrc
+ * Snapshot is the rc path with .snap added
+ * */
+void initRc(void)
+{
+	char rcPath[4096];
+	char * rcEnv = getenv("SMALLSHRC");
+	char * home = getenv("HOME");
+	struct RcHeader header;
+	struct stat info;
+
+	if(rcEnv != NULL)
+		snprintf(rcPath, sizeof(rcPath), "%s", rcEnv);
+	else if(home != NULL)
+		snprintf(rcPath, sizeof(rcPath), "%s/%s", home, RC_FILE);
+	else
+		return;
+
+	// No rc file, nothing to run
+	if(stat(rcPath, &info) == -1)
+		return;
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, RC_MAGIC, sizeof(header.magic));
+	header.mtimeSec = info.st_mtim.tv_sec;
+	header.mtimeNsec = info.st_mtim.tv_nsec;
+	header.size = info.st_size;
+	header.inode = info.st_ino;
+
+	snprintf(snapPath, sizeof(snapPath), "%s.snap", rcPath);
+	if(mapSnap(&header) == -1)
+	{
+		if(buildSnap(rcPath, &header) == -1)
+		{
+			freeRc();
+			return;
+		}
+		saveSnap();
+	}
+
+	cursor = sizeof(struct RcHeader);
+}
+
+/*
+ * GET STRING FROM SNAPSHOT
+ * Returns NULL if it runs past the end or is too long for dest
+ * */
+static char * getString(char * dest, size_t destSize)
+{
+	char * str = snap + cursor;
+	char * end = memchr(str, '\0', snapSize - cursor);
+
+	if(end == NULL || (dest != NULL && (size_t)(end - str) >= destSize))
+		return NULL;
+
+	cursor += end - str + 1;
+	if(dest != NULL)
+		strcpy(dest, str);
+	return str;
+}
+
+/*
+ * UNPACK PARSED COMMAND
+ * Returns -1 if the record is damaged
+ * */
+static int getParsed(struct Cmd * command)
+{
+	unsigned char flags, numTee, teeAppend;
+	uint16_t numArgs;
+	char * arg = NULL;
+	int i;
+
+	if(snapSize - cursor < 3 + sizeof(numArgs))
+		return -1;
+	flags = snap[cursor++];
+	numTee = snap[cursor++];
+	teeAppend = snap[cursor++];
+	memcpy(&numArgs, snap + cursor, sizeof(numArgs));
+	cursor += sizeof(numArgs);
+	if(numTee > MAX_TEE)
+		return -1;
+
+	command->bgProc = (flags & RC_BG) && !fgMode;
+	command->redirStdin = (flags & RC_STDIN) != 0;
+	command->redirStdout = (flags & RC_STDOUT) != 0;
+	command->stdoutAppend = (flags & RC_APPEND) != 0;
+	command->teeStdout = (flags & RC_TEE_STDOUT) != 0;
+
+	if(getString(command->stdinFile, WORD_SIZE) == NULL || getString(command->stdoutFile, WORD_SIZE) == NULL)
+		return -1;
+	for(i = 0; i < numTee; i++)
+	{
+		if(getString(command->teeFile[i], WORD_SIZE) == NULL)
+			return -1;
+		command->teeAppend[i] = (teeAppend >> i) & 1;
+		command->numTee++;
+	}
+
+	command->args = malloc(sizeof(char *) * (numArgs + 1));
+	if(command->args == NULL) exit(5);
+	for(i = 0; i < numArgs; i++)
+	{
+		command->args[i] = NULL;
+		arg = getString(NULL, 0);
+		if(arg == NULL)
+			return -1;
+		command->args[i] = malloc(strlen(arg) + 1);
+		if(command->args[i] == NULL) exit(5);
+		strcpy(command->args[i], arg);
+		command->numArgs++;
+	}
+	command->args[numArgs] = NULL;
+
+	return 0;
+}
+
+/*
+ * TAKE NEXT RC COMMAND
+ * Returns 1 with command filled in, or 0 when there are no more
+ * */
+int nextRc(struct Cmd * command)
+{
+	char * line = NULL;
+	int kind;
+
+	if(snap == NULL)
+		return 0;
+
+	if(cursor >= snapSize)
+	{
+		freeRc();
+		return 0;
+	}
+
+	kind = snap[cursor++];
+	initCmd(command);
+
+	if(kind == RC_RAW && (line = getString(NULL, 0)) != NULL)
+	{
+		parseCmd(command, line);
+		return 1;
+	}
+
+	if(kind == RC_PARSED && getParsed(command) == 0)
+		return 1;
+
+	// Damaged, stop here and rebuild next time
+	outPrintf("smallsh: rc snapshot damaged, rest of rc file skipped\n");
+	if(command->args != NULL)
+		destroyCmd(command);
+	unlink(snapPath);
+	freeRc();
+	return 0;
+}
+
+/*
+ * FREE RC SNAPSHOT
+ * */
+void freeRc(void)
+{
+	if(snap != NULL)
+	{
+		if(snapMapped)
+			munmap(snap, snapSize);
+		else
+			free(snap);
+	}
+
+	snap = NULL;
+	snapSize = 0;
+	snapMapped = 0;
+	buildCap = 0;
+	cursor = 0;
+}
@@ -0,0 +1,30 @@
+/*
+ * RC FILE HEADER FILE
+ *
+ * Startup commands from ~/.smallshrc
+ * The parsed commands are kept in a snapshot file next to the rc file,
+ * and rebuilt only when the rc file changes. Startup just maps the
+ * snapshot; each command is unpacked when it's about to run.
+ *
+ * Exit Error 5 indicates error with malloc
+ * */
+
+#ifndef RC_FILE_H
+#define RC_FILE_H
+
+// Header files
+#include <stdio.h>
+#include <stdlib.h>
+#include "cmd.h"
+
+// Constants
+#ifndef RC_FILE
+#define RC_FILE ".smallshrc"
+#endif
+
+// Function prototypes
+void initRc(void);								// Find rc file and map its snapshot
+int nextRc(struct Cmd * command);				// Take next rc command, 0 when done
+void freeRc(void);								// Unmap snapshot
+
+#endif
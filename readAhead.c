@@ -0,0 +1,198 @@
+/*
+ * READ AHEAD IMPLEMENTATION FILE
+ *
+ * Batch mode input: a thread reads and parses script lines ahead of
+ * the main thread into a fixed ring of commands, so the main thread
+ * only has to spawn and wait
+ *
+ * The ring has one producer and one consumer, so the indexes are the
+ * only shared state. Each side only sleeps when the ring is full or
+ * empty: the reader on a futex, the main thread in the event loop, so
+ * background jobs keep being looked after while a slow script is read.
+ *
+ * Parsing doesn't depend on shell state that can change between lines:
+ * cd and bg jobs don't affect it, $$ never changes, and history is only
+ * expanded in interactive shells. The one exception, foreground-only
+ * mode, is applied when the command is taken instead.
+ * */
+
+// Header files
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <errno.h>
+#include <signal.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include "readAhead.h"
+#include "lexer.h"
+#include "eventLoop.h"
+#include "output.h"
+
+// Global foreground mode
+extern unsigned int fgMode;
+
+// One parsed line
+struct ReadSlot
+{
+	struct Cmd command;
+	const char * error;				// Syntax error, command is empty
+	int end;						// End of input, no command
+};
+
+// Ring of parsed lines
+// head is the next slot to take, tail the next to fill
+// Both only increase, wrapping at 2^32
+static struct ReadSlot slots[READ_AHEAD_SIZE];
+static _Atomic uint32_t head = 0;
+static _Atomic uint32_t tail = 0;
+static _Atomic int readerSleeping = 0;
+static _Atomic int mainSleeping = 0;
+
+static FILE * source = NULL;
+
+/*
+ * SLEEP UNTIL INDEX CHANGES FROM VALUE
+ * Sleeping flag is set first, so the other side knows to wake us
+ * */
+static void waitIndex(_Atomic uint32_t * index, uint32_t value, _Atomic int * sleeping)
+{
+	atomic_store(sleeping, 1);
+	if(atomic_load(index) == value)
+		syscall(SYS_futex, (uint32_t *)index, FUTEX_WAIT_PRIVATE, value, NULL, NULL, 0);
+	atomic_store(sleeping, 0);
+}
+
+/*
+ * WAKE OTHER SIDE IF IT'S WAITING ON INDEX
+ * */
+static void wakeIndex(_Atomic uint32_t * index, _Atomic int * sleeping)
+{
+	if(atomic_load(sleeping))
+		syscall(SYS_futex, (uint32_t *)index, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+}
+
+/*
+ * READER THREAD
+ * Parses each line into the ring, and marks end of input
+ * */
+static void * reader(void * unused)
+{
+	struct ReadSlot * slot = NULL;
+	char * line = NULL;
+	size_t size = 0;
+	uint32_t pos = 0;
+	int end = 0;
+
+	(void)unused;
+
+	while(!end)
+	{
+		// Wait for room
+		pos = atomic_load_explicit(&tail, memory_order_relaxed);
+		while(pos - atomic_load_explicit(&head, memory_order_acquire) == READ_AHEAD_SIZE)
+			waitIndex(&head, pos - READ_AHEAD_SIZE, &readerSleeping);
+
+		slot = &slots[pos & (READ_AHEAD_SIZE - 1)];
+		slot->error = NULL;
+		slot->end = 0;
+
+		// Blocked signals can't interrupt this, so -1 is really the end
+		if(getline(&line, &size, source) == -1)
+		{
+			slot->end = 1;
+			end = 1;
+		}
+		else
+		{
+			initCmd(&slot->command);
+			slot->error = parseCmdQuiet(&slot->command, line);
+		}
+
+		// Publish
+		// Full barrier, so the sleeping flag is read after the store
+		atomic_store(&tail, pos + 1);
+		if(atomic_load(&mainSleeping))
+			evWake();
+	}
+
+	free(line);
+	return NULL;
+}
+
+/*
+ * START READ AHEAD
+ * Input must not be read by anything else afterwards
+ * */
+int startReadAhead(FILE * input)
+{
+	pthread_t thread;
+	sigset_t all, old;
+	int result = 0;
+
+	source = input;
+
+	// Lexer sets itself up on first use, do it before there's a race
+	initLexer();
+
+	// Signals stay with the main thread
+	sigfillset(&all);
+	pthread_sigmask(SIG_BLOCK, &all, &old);
+	result = pthread_create(&thread, NULL, reader, NULL);
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+	if(result != 0)
+		return -1;
+
+	pthread_detach(thread);
+	return 0;
+}
+
+/*
+ * TAKE NEXT COMMAND
+ * Waits in the event loop, so other watched fds are served meanwhile
+ * Returns 1 with command filled in, 0 at end of input, or -1 if
+ * interrupted before a line came in
+ * */
+int nextReadAhead(struct Cmd * command)
+{
+	struct ReadSlot * slot = NULL;
+	uint32_t pos = atomic_load_explicit(&head, memory_order_relaxed);
+	int result = 0;
+
+	// Wait for a line
+	// Sleeping flag is set first, so the reader knows to wake us
+	while(atomic_load_explicit(&tail, memory_order_acquire) == pos)
+	{
+		atomic_store(&mainSleeping, 1);
+		if(atomic_load(&tail) == pos)
+			result = evRunOnce(-1);
+		atomic_store(&mainSleeping, 0);
+
+		if(result == -1 && atomic_load_explicit(&tail, memory_order_acquire) == pos)
+			return -1;
+	}
+
+	slot = &slots[pos & (READ_AHEAD_SIZE - 1)];
+
+	// Leave end marker in place, so later calls see it too
+	if(slot->end)
+		return 0;
+
+	*command = slot->command;
+	if(slot->error != NULL)
+		outPrintf("smallsh: %s\n", slot->error);
+	if(fgMode)
+		command->bgProc = 0;
+
+	// Hand slot back
+	// Full barrier, so the sleeping flag is read after the store
+	atomic_store(&head, pos + 1);
+	wakeIndex(&head, &readerSleeping);
+
+	return 1;
+}
@@ -0,0 +1,27 @@
+/*
+ * READ AHEAD HEADER FILE
+ *
+ * Batch mode input: a thread reads and parses script lines ahead of
+ * the main thread into a fixed ring of commands, so the main thread
+ * only has to spawn and wait
+ * */
+
+#ifndef READ_AHEAD_H
+#define READ_AHEAD_H
+
+// Header files
+#include <stdio.h>
+#include <stdlib.h>
+#include "cmd.h"
+
+// Constants
+// Must be a power of 2
+#ifndef READ_AHEAD_SIZE
+#define READ_AHEAD_SIZE 64
+#endif
+
+// Function prototypes
+int startReadAhead(FILE * input);						// Start reader thread, -1 on error
+int nextReadAhead(struct Cmd * command);				// Take next command, 0 at end of input, -1 if interrupted
+
+#endif
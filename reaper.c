@@ -0,0 +1,389 @@
+/*
+ * REAPER IMPLEMENTATION FILE
+ *
+ * Child subreaper mode: orphaned descendants of the shell's jobs are
+ * reparented to the shell instead of init, tracked and reaped like
+ * bg processes, and the whole process tree is shut down on exit
+ * */
+
+// Header files
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <signal.h>
+#include <dirent.h>
+#include <sys/prctl.h>
+#include <sys/wait.h>
+#include "reaper.h"
+#include "output.h"
+
+// Time between checks while waiting for the tree to exit
+#define REAPER_POLL_MS 10
+
+// How long to wait for SIGKILL to take before giving up
+#define REAPER_KILL_MS 1000
+
+// Spawned processes kept before dropping ones already gone
+#define REAPER_SPAWNED_MAX 64
+
+// Mode and grace period before SIGKILL on exit
+static int subreaperOn = 0;
+static int graceMs = REAPER_GRACE_MS;
+
+// Orphans adopted from jobs, reaped along with bg processes
+struct LinkedList adoptedProcs;
+
+// Every process the shell started itself, bg or not
+// Never taken for orphans
+static struct LinkedList spawnedProcs;
+
+/*
+ * INITIALIZE REAPER
+ * */
+void initReaper(void)
+{
+	initList(&adoptedProcs);
+	initList(&spawnedProcs);
+}
+
+/*
+ * IS SUBREAPER MODE ON
+ * */
+int isSubreaper(void)
+{
+	return subreaperOn;
+}
+
+/*
+ * TURN SUBREAPER MODE ON OR OFF
+ * */
+int setSubreaper(int on)
+{
+	if(prctl(PR_SET_CHILD_SUBREAPER, on ? 1 : 0, 0, 0, 0) == -1)
+		return -1;
+
+	subreaperOn = on;
+	return 0;
+}
+
+/*
+ * GRACE PERIOD BEFORE SIGKILL
+ * */
+int getReaperGrace(void)
+{
+	return graceMs;
+}
+
+/*
+ * ADD CHILDREN OF PROCESS TO LIST
+ * Reads /proc/PID/task/TID/children for every thread
+ * */
+static void listChildren(pid_t pid, struct LinkedList * list)
+{
+	char path[64];
+	char taskPath[512];
+	struct dirent * task = NULL;
+	DIR * tasks = NULL;
+	FILE * children = NULL;
+	int child = 0;
+
+	snprintf(path, sizeof(path), "/proc/%d/task", (int)pid);
+	tasks = opendir(path);
+	if(tasks == NULL)
+		return;
+
+	while((task = readdir(tasks)) != NULL)
+	{
+		if(task->d_name[0] == '.')
+			continue;
+
+		snprintf(taskPath, sizeof(taskPath), "%s/%s/children", path, task->d_name);
+		children = fopen(taskPath, "r");
+		if(children == NULL)
+			continue;
+
+		while(fscanf(children, "%d", &child) == 1)
+		{
+			if(!listContains(list, child))
+				pushList(list, child);
+		}
+		fclose(children);
+	}
+
+	closedir(tasks);
+}
+
+/*
+ * ADD ALL DESCENDANTS OF SHELL TO LIST
+ * List is walked as it grows, so grandchildren are found too
+ * */
+static void listTree(struct LinkedList * list)
+{
+	struct ListIter iter;
+
+	listChildren(getpid(), list);
+
+	initListIter(&iter, list);
+	while(listIterHasNext(&iter))
+		listChildren(listIterNext(&iter), list);
+}
+
+/*
+ * FORGET SPAWNED PROCESSES THAT HAVE BEEN REAPED
+ * Anything no longer a child of the shell is gone
+ * */
+static void pruneSpawned(struct LinkedList * children)
+{
+	struct LinkedList gone;
+	struct ListIter iter;
+	pid_t pid = 0;
+
+	initList(&gone);
+	initListIter(&iter, &spawnedProcs);
+	while(listIterHasNext(&iter))
+	{
+		pid = listIterNext(&iter);
+		if(!listContains(children, pid))
+			pushList(&gone, pid);
+	}
+
+	initListIter(&iter, &gone);
+	while(listIterHasNext(&iter))
+		removeFromList(&spawnedProcs, listIterNext(&iter));
+	freeList(&gone);
+}
+
+/*
+ * RECORD PROCESS STARTED BY SHELL
+ * Called after each fork(), so foreground and dag children aren't
+ * taken for orphans
+ * */
+void noteSpawned(pid_t pid)
+{
+	struct LinkedList children;
+
+	if(!subreaperOn || pid <= 0)
+		return;
+
+	pushList(&spawnedProcs, pid);
+	if(getSize(&spawnedProcs) > REAPER_SPAWNED_MAX)
+	{
+		initList(&children);
+		listChildren(getpid(), &children);
+		pruneSpawned(&children);
+		freeList(&children);
+	}
+}
+
+/*
+ * TRACK ADOPTED CHILDREN
+ * Any child of the shell it didn't start itself is an orphan it adopted
+ * */
+void adoptOrphans(struct LinkedList * known)
+{
+	struct LinkedList children;
+	struct ListIter iter;
+	pid_t pid = 0;
+
+	if(!subreaperOn)
+		return;
+
+	initList(&children);
+	listChildren(getpid(), &children);
+
+	initListIter(&iter, &children);
+	while(listIterHasNext(&iter))
+	{
+		pid = listIterNext(&iter);
+		if(!listContains(known, pid) && !listContains(&spawnedProcs, pid)
+				&& !listContains(&adoptedProcs, pid))
+			pushList(&adoptedProcs, pid);
+	}
+
+	pruneSpawned(&children);
+	freeList(&children);
+}
+
+/*
+ * SIGNAL EVERY PROCESS IN LIST
+ * Skips any in skip, which may be NULL
+ * */
+static void signalList(struct LinkedList * list, int signo, struct LinkedList * skip)
+{
+	struct ListIter iter;
+	pid_t pid = 0;
+
+	initListIter(&iter, list);
+	while(listIterHasNext(&iter))
+	{
+		pid = listIterNext(&iter);
+		if(skip == NULL || !listContains(skip, pid))
+			kill(pid, signo);
+	}
+}
+
+/*
+ * ADD PROCESSES IN FROM TO LIST
+ * */
+static void addAll(struct LinkedList * list, struct LinkedList * from)
+{
+	struct ListIter iter;
+	pid_t pid = 0;
+
+	initListIter(&iter, from);
+	while(listIterHasNext(&iter))
+	{
+		pid = listIterNext(&iter);
+		if(!listContains(list, pid))
+			pushList(list, pid);
+	}
+}
+
+/*
+ * REAP CHILDREN AND DROP EXITED PROCESSES FROM LIST
+ * Returns number still alive
+ * */
+static int reapTree(struct LinkedList * list)
+{
+	struct LinkedList gone;
+	struct ListIter iter;
+	pid_t pid = 0;
+
+	// Reap every child that's done, including newly adopted ones
+	while(waitpid(-1, NULL, WNOHANG) > 0);
+
+	// Processes that aren't our children can only be checked with kill()
+	initList(&gone);
+	initListIter(&iter, list);
+	while(listIterHasNext(&iter))
+	{
+		pid = listIterNext(&iter);
+		if(kill(pid, 0) == -1 && errno == ESRCH)
+			pushList(&gone, pid);
+	}
+
+	initListIter(&iter, &gone);
+	while(listIterHasNext(&iter))
+		removeFromList(list, listIterNext(&iter));
+	freeList(&gone);
+
+	return getSize(list);
+}
+
+/*
+ * SHUT DOWN WHOLE PROCESS TREE
+ * known jobs have already had SIGTERM, everything else found is sent it
+ * now, then all of it is waited for together until the grace period
+ * runs out, then SIGKILL whatever is left and report anything that
+ * still hasn't gone after REAPER_KILL_MS
+ * Without /proc/PID/task/TID/children only known and adopted processes
+ * can be found
+ * */
+void shutdownTree(struct LinkedList * known)
+{
+	struct LinkedList tree;
+	struct timespec pause = { 0, REAPER_POLL_MS * 1000000L };
+	int waited = 0;
+
+	initList(&tree);
+	listTree(&tree);
+	addAll(&tree, &adoptedProcs);
+	signalList(&tree, SIGTERM, known);
+	addAll(&tree, known);
+
+	while(reapTree(&tree) > 0 && waited < graceMs)
+	{
+		nanosleep(&pause, NULL);
+		waited += REAPER_POLL_MS;
+
+		// Catch anything forked since
+		listTree(&tree);
+	}
+
+	// Out of time
+	if(getSize(&tree) > 0)
+	{
+		listTree(&tree);
+		signalList(&tree, SIGKILL, NULL);
+
+		// Stuck in the kernel (D state, stopped tracer), don't hang on it
+		waited = 0;
+		while(reapTree(&tree) > 0 && waited < REAPER_KILL_MS)
+		{
+			nanosleep(&pause, NULL);
+			waited += REAPER_POLL_MS;
+		}
+		if(getSize(&tree) > 0)
+		{
+			outPrintf("subreaper: still running after SIGKILL: ");
+			printList(&tree);
+		}
+	}
+
+	freeList(&tree);
+}
+
+/*
+ * LIST ADOPTED PROCESSES
+ * */
+void printAdopted(void)
+{
+	if(getSize(&adoptedProcs) == 0)
+		return;
+
+	outPrintf("adopted: ");
+	printList(&adoptedProcs);
+}
+
+/*
+ * SUBREAPER BUILTIN
+ * subreaper                show mode
+ * subreaper on [GRACE_MS]  adopt orphans, GRACE_MS before SIGKILL on exit
+ * subreaper off
+ * */
+void subreaperBuiltin(char ** args)
+{
+	char * end = NULL;
+	long val;
+
+	if(args[1] == NULL)
+	{
+		if(subreaperOn)
+			outPrintf("subreaper on %d\n", graceMs);
+		else
+			outPrintf("subreaper off\n");
+		return;
+	}
+
+	if(!strcmp("on", args[1]) && args[2] != NULL)
+	{
+		val = strtol(args[2], &end, 10);
+		if(*end != '\0' || end == args[2] || val < 0)
+		{
+			outPrintf("subreaper: invalid grace period %s\n", args[2]);
+			return;
+		}
+		graceMs = (int)val;
+	}
+
+	if(strcmp("on", args[1]) && strcmp("off", args[1]))
+	{
+		outPrintf("subreaper: unknown option %s\n", args[1]);
+		return;
+	}
+
+	if(setSubreaper(!strcmp("on", args[1])) == -1)
+		outPrintf("subreaper: not supported\n");
+}
+
+/*
+ * FREE REAPER
+ * */
+void freeReaper(void)
+{
+	freeList(&adoptedProcs);
+	freeList(&spawnedProcs);
+}
@@ -0,0 +1,34 @@
+/*
+ * REAPER HEADER FILE
+ *
+ * Child subreaper mode: orphaned descendants of the shell's jobs are
+ * reparented to the shell instead of init, tracked and reaped like
+ * bg processes, and the whole process tree is shut down on exit
+ * */
+
+#ifndef REAPER_H
+#define REAPER_H
+
+// Header files
+#include <stdio.h>
+#include <stdlib.h>
+#include "linkedList.h"
+
+// Constants
+#ifndef REAPER_GRACE_MS
+#define REAPER_GRACE_MS 2000
+#endif
+
+// Function prototypes
+void initReaper(void);													// Set up adopted process list
+int isSubreaper(void);													// Is subreaper mode on
+int setSubreaper(int on);												// Turn mode on/off, -1 on error
+int getReaperGrace(void);												// Grace period before SIGKILL, in ms
+void noteSpawned(pid_t pid);											// Record child launched by shell
+void adoptOrphans(struct LinkedList * known);							// Track children not launched by shell
+void shutdownTree(struct LinkedList * known);							// TERM, wait, then KILL all descendants
+void printAdopted(void);												// List adopted processes
+void subreaperBuiltin(char ** args);									// subreaper builtin
+void freeReaper(void);													// Free adopted process list
+
+#endif
@@ -0,0 +1,507 @@
+/*
+ * SERVER IMPLEMENTATION FILE
+ *
+ * Command server on a Unix domain socket (smallsh --serve PATH)
+ * See server.h for the protocol
+ * */
+
+// Needed for accept4()
+#define _GNU_SOURCE
+
+// Header files
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include <sys/signalfd.h>
+#include "server.h"
+#include "eventLoop.h"
+#include "cmd.h"
+#include "spawn.h"
+#include "output.h"
+
+// Constants
+#ifndef SERVER_LINE_SIZE
+#define SERVER_LINE_SIZE 2049
+#endif
+
+// Most fds passed with one message
+#define SERVER_MAX_FDS 2
+
+// Global resource limits and background policy
+// Comes from jobLimits.h and jobSched.h libraries
+extern struct JobLimits jobLimitDefault;
+extern int bgSchedOn;
+extern struct SchedOpts bgSchedDefault;
+
+/* Each Connected Client */
+struct Client
+{
+	struct Client * next;
+	int fd;									// Connection
+	char buf[SERVER_LINE_SIZE];				// Input not yet run
+	size_t used;							// Bytes of buf used
+	int passed[SERVER_MAX_FDS];				// Fds passed for next command
+	int passedCount;						// Number of fds passed
+	pid_t running;							// Command running, or 0
+	int hungUp;								// Client sent EOF while command was running
+	int reading;							// Is fd in event loop for reading
+	int writing;							// Is fd in event loop for writing
+	char * out;								// Replies client hasn't taken yet
+	size_t outUsed;							// Bytes of out used
+	size_t outSize;							// Bytes of out allocated
+};
+
+// Server state
+static struct Client * clients = NULL;
+static int devNull = -1;
+
+// Function prototypes
+static int runNext(struct Client * client);
+static void onClientReadable(int fd, void * data);
+static void onClientWritable(int fd, void * data);
+
+/*
+ * SEND WITHOUT BLOCKING
+ * Socket itself stays blocking, it may be a child's stdout
+ * Never raises SIGPIPE if client went away
+ * Returns bytes sent, or -1 on error other than a full socket
+ * */
+static ssize_t sendSome(struct Client * client, const char * text, size_t len)
+{
+	size_t done = 0;
+	ssize_t sent = 0;
+
+	while(done < len)
+	{
+		sent = send(client->fd, text + done, len - done, MSG_NOSIGNAL | MSG_DONTWAIT);
+		if(sent == -1)
+		{
+			if(errno == EINTR)
+				continue;
+			if(errno == EAGAIN || errno == EWOULDBLOCK)
+				break;
+			return -1;
+		}
+		done += sent;
+	}
+
+	return done;
+}
+
+/*
+ * SEND LINE TO CLIENT
+ * Whatever the socket won't take now waits in the client's buffer, and
+ * the client isn't read from or run for until it has been sent
+ * */
+static void sendLine(struct Client * client, const char * line)
+{
+	size_t len = strlen(line);
+	ssize_t sent = 0;
+
+	// Keep replies in order behind any still waiting
+	if(client->outUsed == 0)
+	{
+		sent = sendSome(client, line, len);
+		if(sent == -1 || (size_t)sent == len)
+			return;
+		line += sent;
+		len -= sent;
+	}
+
+	if(client->outUsed + len > client->outSize)
+	{
+		client->outSize = (client->outUsed + len) * 2;
+		client->out = realloc(client->out, client->outSize);
+		if(client->out == NULL) exit(20);
+	}
+	memcpy(client->out + client->outUsed, line, len);
+	client->outUsed += len;
+
+	// Only one watch per fd, so stop reading until replies are taken
+	if(!client->writing)
+	{
+		evAddWrite(client->fd, onClientWritable, client);
+		client->reading = 0;
+		client->writing = 1;
+	}
+}
+
+/*
+ * CLOSE FDS PASSED BY CLIENT
+ * */
+static void closePassed(struct Client * client)
+{
+	int i = 0;
+
+	for(i = 0; i < client->passedCount; i++)
+		close(client->passed[i]);
+	client->passedCount = 0;
+}
+
+/*
+ * DISCONNECT CLIENT
+ * */
+static void closeClient(struct Client * client)
+{
+	struct Client ** link = &clients;
+
+	if(client->reading || client->writing)
+		evRemove(client->fd);
+	closePassed(client);
+	close(client->fd);
+	free(client->out);
+
+	// Unlink from list
+	while(*link != client)
+		link = &(*link)->next;
+	*link = client->next;
+
+	free(client);
+}
+
+/*
+ * CLIENT SENT DATA
+ * */
+static void onClientReadable(int fd, void * data)
+{
+	struct Client * client = data;
+	char control[CMSG_SPACE(sizeof(int) * SERVER_MAX_FDS)];
+	struct msghdr msg;
+	struct iovec iov;
+	struct cmsghdr * cmsg = NULL;
+	ssize_t got = 0;
+	int count = 0;
+	int i = 0;
+
+	// Buffer full until running command finishes
+	if(client->used == sizeof(client->buf))
+	{
+		evRemove(fd);
+		client->reading = 0;
+		return;
+	}
+
+	memset(&msg, 0, sizeof(msg));
+	iov.iov_base = client->buf + client->used;
+	iov.iov_len = sizeof(client->buf) - client->used;
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control;
+	msg.msg_controllen = sizeof(control);
+
+	got = recvmsg(fd, &msg, MSG_CMSG_CLOEXEC | MSG_DONTWAIT);
+	if(got == -1 && (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK))
+		return;
+
+	// Hung up, finish running lines already sent before closing
+	if(got <= 0)
+	{
+		if(client->running)
+		{
+			evRemove(fd);
+			client->reading = 0;
+			client->hungUp = 1;
+		}
+		else
+			closeClient(client);
+		return;
+	}
+	client->used += got;
+
+	// Fds passed replace any passed before
+	for(cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg))
+	{
+		if(cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+			continue;
+
+		closePassed(client);
+		count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+		for(i = 0; i < count; i++)
+		{
+			if(i < SERVER_MAX_FDS)
+				client->passed[client->passedCount++] = ((int *)CMSG_DATA(cmsg))[i];
+			else
+				close(((int *)CMSG_DATA(cmsg))[i]);
+		}
+	}
+
+	if(!client->running)
+		runNext(client);
+}
+
+/*
+ * CLIENT CAN TAKE MORE REPLIES
+ * */
+static void onClientWritable(int fd, void * data)
+{
+	struct Client * client = data;
+	ssize_t sent = sendSome(client, client->out, client->outUsed);
+
+	// Gone, nothing more will reach it
+	if(sent == -1)
+	{
+		client->outUsed = 0;
+		client->hungUp = 1;
+	}
+	else
+	{
+		client->outUsed -= sent;
+		memmove(client->out, client->out + sent, client->outUsed);
+		if(client->outUsed > 0)
+			return;
+	}
+
+	evRemove(fd);
+	client->writing = 0;
+	if(!client->hungUp)
+	{
+		evAdd(fd, onClientReadable, client);
+		client->reading = 1;
+	}
+
+	// Lines that came in while waiting
+	if(!client->running && !runNext(client))
+		return;
+	if(client->hungUp && !client->running && client->outUsed == 0)
+		closeClient(client);
+}
+
+/*
+ * RUN NEXT COMPLETE LINE FROM CLIENT
+ * Returns 0 if client was closed
+ * */
+static int runNext(struct Client * client)
+{
+	struct Cmd command;
+	char line[SERVER_LINE_SIZE + 1];
+	char reply[SERVER_LINE_SIZE + 32];
+	char * newLine = NULL;
+	const char * error = NULL;
+	size_t len = 0;
+
+	// Replies waiting means the client isn't keeping up, so wait for it
+	while(!client->running && client->outUsed == 0)
+	{
+		newLine = memchr(client->buf, '\n', client->used);
+		if(newLine == NULL)
+		{
+			// Line too long to ever finish
+			if(client->used == sizeof(client->buf))
+			{
+				sendLine(client, "error line too long\n");
+				client->used = 0;
+			}
+			return 1;
+		}
+
+		// Take line out of buffer
+		len = newLine - client->buf + 1;
+		memcpy(line, client->buf, len);
+		line[len] = '\0';
+		client->used -= len;
+		memmove(client->buf, client->buf + len, client->used);
+
+		initCmd(&command);
+		error = parseCmdQuiet(&command, line);
+		if(error != NULL)
+		{
+			snprintf(reply, sizeof(reply), "error %s\n", error);
+			sendLine(client, reply);
+			destroyCmd(&command);
+			continue;
+		}
+
+		// Nothing to run, empty reply so the client isn't left waiting
+		if( (command.args[0] == NULL) || ('#' == command.args[0][0]) )
+		{
+			sendLine(client, "\n");
+			destroyCmd(&command);
+			continue;
+		}
+
+		// exit ends this client's session
+		if(!strcmp("exit", command.args[0]))
+		{
+			destroyCmd(&command);
+			closeClient(client);
+			return 0;
+		}
+
+		if(ss_prefixes(&command) == -1)
+		{
+			sendLine(client, "error invalid prefix\n");
+			destroyCmd(&command);
+			continue;
+		}
+
+		// Shell-wide policies apply like they do at the prompt
+		if(command.bgProc && bgSchedOn)
+			mergeSched(&command.sched, &bgSchedDefault);
+		mergeLimits(&command.limits, &jobLimitDefault);
+		command.bgProc = 0;
+
+		// Client's fds, or /dev/null and the socket
+		if(client->passedCount == SERVER_MAX_FDS)
+		{
+			command.stdinFd = client->passed[0];
+			command.stdoutFd = client->passed[1];
+		}
+		else
+		{
+			command.stdinFd = devNull;
+			command.stdoutFd = (client->passedCount == 1) ? client->passed[0] : client->fd;
+		}
+
+		client->running = ss_spawn(&command);
+		destroyCmd(&command);
+
+		// Child has its own copies now
+		closePassed(client);
+
+		if(client->running == -1)
+		{
+			client->running = 0;
+			sendLine(client, "error cannot fork\n");
+		}
+	}
+
+	return 1;
+}
+
+/*
+ * CHILD PROCESSES FINISHED
+ * Reply to each one's client with status and resource usage
+ * */
+static void onSigchld(int fd, void * data)
+{
+	struct signalfd_siginfo info;
+	struct rusage usage;
+	struct Client * client = NULL;
+	char reply[256];
+	int childExitMethod = 0;
+	pid_t pid = 0;
+
+	// Drain signal, one read may stand for several children
+	while(read(fd, &info, sizeof(info)) == sizeof(info));
+
+	while((pid = wait4(-1, &childExitMethod, WNOHANG, &usage)) > 0)
+	{
+		for(client = clients; client != NULL && client->running != pid; client = client->next);
+		if(client == NULL)
+			continue;
+
+		snprintf(reply, sizeof(reply), "status %s %d utime %ld stime %ld maxrss %ld\n",
+				WIFEXITED(childExitMethod) ? "exit" : "signal",
+				WIFEXITED(childExitMethod) ? WEXITSTATUS(childExitMethod) : WTERMSIG(childExitMethod),
+				(long)usage.ru_utime.tv_sec * 1000000 + usage.ru_utime.tv_usec,
+				(long)usage.ru_stime.tv_sec * 1000000 + usage.ru_stime.tv_usec,
+				usage.ru_maxrss);
+		sendLine(client, reply);
+		client->running = 0;
+
+		// Start reading again if buffer had filled
+		if(!client->reading && !client->writing && !client->hungUp)
+		{
+			evAdd(client->fd, onClientReadable, client);
+			client->reading = 1;
+		}
+		if(!runNext(client))
+			continue;
+
+		// Lines sent before hanging up have all been run and answered
+		if(client->hungUp && !client->running && client->outUsed == 0)
+			closeClient(client);
+	}
+}
+
+/*
+ * NEW CLIENT CONNECTED
+ * Connection stays blocking, since it may become a child's stdout
+ * The server's own sends and receives never wait on it
+ * */
+static void onAccept(int fd, void * data)
+{
+	struct Client * client = NULL;
+	int clientFd = accept4(fd, NULL, NULL, SOCK_CLOEXEC);
+
+	if(clientFd == -1)
+		return;
+
+	client = malloc(sizeof(struct Client));
+	if(client == NULL) exit(20);
+	memset(client, 0, sizeof(struct Client));
+	client->fd = clientFd;
+	client->reading = 1;
+	client->next = clients;
+	clients = client;
+
+	evAdd(clientFd, onClientReadable, client);
+}
+
+/*
+ * RUN SERVER
+ * Returns exit code for smallsh if server couldn't start
+ * */
+int serveSocket(const char * path)
+{
+	struct sockaddr_un addr;
+	struct stat pathStat;
+	sigset_t mask;
+	int listenFd = -1;
+	int sigFd = -1;
+
+	if(strlen(path) >= sizeof(addr.sun_path))
+	{
+		fprintf(stderr, "smallsh: socket path too long\n");
+		return 1;
+	}
+
+	// Remove socket left by an earlier server
+	if(stat(path, &pathStat) == 0 && S_ISSOCK(pathStat.st_mode))
+		unlink(path);
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+
+	listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if(listenFd == -1 || bind(listenFd, (struct sockaddr *)&addr, sizeof(addr)) == -1
+			|| listen(listenFd, SERVER_BACKLOG) == -1)
+	{
+		perror("smallsh: cannot serve socket");
+		return 1;
+	}
+
+	devNull = open("/dev/null", O_RDWR | O_CLOEXEC);
+
+	// Children are reaped from the event loop
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGCHLD);
+	sigprocmask(SIG_BLOCK, &mask, NULL);
+	sigFd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+	if(sigFd == -1)
+	{
+		perror("smallsh: signalfd");
+		return 1;
+	}
+
+	evAdd(listenFd, onAccept, NULL);
+	evAdd(sigFd, onSigchld, NULL);
+
+	while(1)
+	{
+		evRunOnce(-1);
+		outFlush();
+	}
+
+	return 0;
+}
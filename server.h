@@ -0,0 +1,35 @@
+/*
+ * SERVER HEADER FILE
+ *
+ * Command server on a Unix domain socket (smallsh --serve PATH)
+ *
+ * Protocol, one connection per client:
+ *   - Client sends command lines ending in a newline, run one at a time
+ *   - The message carrying a line may pass fds with SCM_RIGHTS:
+ *     one fd is used as stdout, two fds are stdin and stdout
+ *   - Without fds, stdin is /dev/null and stdout is the socket itself
+ *   - When the command finishes the server replies with one line:
+ *       status exit|signal N utime USEC stime USEC maxrss KB
+ *     or, if the command couldn't be run or parsed:
+ *       error MESSAGE
+ *   - Blank and comment lines get an empty line back
+ *
+ * Exit Error 20 indicates error with malloc
+ * */
+
+#ifndef SERVER_H
+#define SERVER_H
+
+// Header files
+#include <stdio.h>
+#include <stdlib.h>
+
+// Constants
+#ifndef SERVER_BACKLOG
+#define SERVER_BACKLOG 64
+#endif
+
+// Function prototypes
+int serveSocket(const char * path);			// Run server until killed, returns exit code
+
+#endif
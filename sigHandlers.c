@@ -4,19 +4,33 @@
 
 // Header files
 #include <unistd.h>
+#include <signal.h>
 #include "cmd.h"
+#include "output.h"
+#include "eventLoop.h"
 
 // Global Foreground Mode
 // Comes from cmd.h library
 extern unsigned int fgMode;
 
+// Set when a bg process finishes or a summary is due
+// while notices are in an async mode
+volatile sig_atomic_t notifySignaled = 0;
+
+// Set when a child process changes state, in any notify mode
+volatile sig_atomic_t childSignaled = 0;
+
+// Set when SIGINT arrives, so the line being edited is thrown away
+volatile sig_atomic_t sigintSignaled = 0;
+
 /*
  * CATCH SIGINT
  * */
 void catchSIGINT(int signo)
 {
 	// Newline to push prompt to next line
-	write(STDOUT_FILENO, "\n", 1);
+	outWriteNow("\n");
+	sigintSignaled = 1;
 }
 
 /*
@@ -29,11 +43,30 @@ void catchSIGTSTP(int signo)
 	
 	// Print message depending on foreground mode
 	if(fgMode)
-		write(STDOUT_FILENO, offMsg, 30);
+		outWriteNow(offMsg);
 	else
-		write(STDOUT_FILENO, onMsg, 50);
+		outWriteNow(onMsg);
 	
 	// Flip foreground mode using bitwise operator
 	fgMode = ~fgMode;
 }
 
+/*
+ * CATCH SIGCHLD/SIGALRM FOR NOTICES
+ * */
+void catchNotify(int signo)
+{
+	// Flag for prompt to check bg processes
+	notifySignaled = 1;
+	evWake();
+}
+
+/*
+ * CATCH SIGCHLD WHEN NOTICES WAIT FOR THE PROMPT
+ * Only wakes the event loop, so queued jobs can start
+ * */
+void catchChild(int signo)
+{
+	childSignaled = 1;
+	evWake();
+}
@@ -13,5 +13,7 @@
 // Signal Handlers
 void catchSIGINT(int signo);
 void catchSIGTSTP(int signo);
+void catchNotify(int signo);
+void catchChild(int signo);
 
 #endif
@@ -4,18 +4,40 @@
 // Header files
 #include <stdio.h>
 #include <unistd.h>
+#include <time.h>
 #include <string.h>
+#include <errno.h>
 #include <stdlib.h>
 #include <signal.h>
 #include <dirent.h>
 #include <fcntl.h>
 #include <sys/stat.h>
+#include <sys/wait.h>
 
 // Custom header files
 #include "linkedList.h"
 #include "cmd.h"
 #include "status.h"
 #include "sigHandlers.h"
+#include "jobSched.h"
+#include "jobLimits.h"
+#include "cmdQueue.h"
+#include "output.h"
+#include "notify.h"
+#include "history.h"
+#include "lineEdit.h"
+#include "complete.h"
+#include "spawn.h"
+#include "server.h"
+#include "reaper.h"
+#include "memo.h"
+#include "dag.h"
+#include "readAhead.h"
+#include "fanout.h"
+#include "rcFile.h"
+#include "watch.h"
+#include "eventLoop.h"
+#include "lexer.h"
 
 // Constants
 #ifndef MAX_LINE_SIZE
@@ -23,18 +45,82 @@
 #endif
 
 // Function prototypes
-void prompt(char * line, const int LINE_SIZE);
+void prompt(char * line, const int LINE_SIZE, struct LinkedList * procs, struct CmdQueue * queue);
 void ss_exit(struct LinkedList * procs);
 void ss_cd(struct Cmd * command);
-int ss_redir_stdin(char * file);
-int ss_redir_stdout(char * file);
-void check_bg_procs(struct LinkedList * procs);
+void reap_procs(struct LinkedList * procs);
+void check_bg_procs(struct LinkedList * procs, struct CmdQueue * queue);
+void ss_bgmax(struct Cmd * command, struct LinkedList * procs, struct CmdQueue * queue);
+void ss_jobs(struct Cmd * command, struct LinkedList * procs, struct CmdQueue * queue);
+void ss_set(struct Cmd * command);
+void startup_phase(const char * name);
+void serve_watches(struct LinkedList * procs, struct CmdQueue * queue);
 
 // Global foreground mode
 extern unsigned int fgMode;
 
-int main()
+// Global flag for bg process notices
+// Comes from sigHandlers.h library
+extern volatile sig_atomic_t notifySignaled;
+extern volatile sig_atomic_t childSignaled;
+extern volatile sig_atomic_t sigintSignaled;
+
+// Global background scheduling policy
+// Comes from jobSched.h library
+extern int bgSchedOn;
+extern struct SchedOpts bgSchedDefault;
+
+// Global resource limits for all jobs
+// Comes from jobLimits.h library
+extern struct JobLimits jobLimitDefault;
+
+// Global list of orphans adopted in subreaper mode
+// Comes from reaper.h library
+extern struct LinkedList adoptedProcs;
+
+// Max number of background processes running at once, 0 for no max
+int bgMax = 0;
+
+// Print time taken by each startup phase
+int startupProfile = 0;
+
+int main(int argc, char * argv[])
 {
+	// Command line options
+	int i = 0;
+	char * servePath = NULL;
+	int useRc = 1;
+	startup_phase(NULL);
+
+	// Before --subreaper and the server, which spawn too
+	initReaper();
+	for(i = 1; i < argc; i++)
+	{
+		if(!strcmp("--serve", argv[i]) && i + 1 < argc)
+			servePath = argv[++i];
+		else if(!strcmp("--norc", argv[i]))
+			useRc = 0;
+		else if(!strcmp("--startup-profile", argv[i]))
+			startupProfile = 1;
+		else if(!strcmp("--check-lexer", argv[i]))
+			return checkScanners() == 0 ? 0 : 1;
+		else if(!strcmp("--subreaper", argv[i]))
+		{
+			if(setSubreaper(1) == -1)
+				fprintf(stderr, "smallsh: subreaper mode not supported\n");
+		}
+		else
+		{
+			fprintf(stderr, "usage: smallsh [--norc] [--startup-profile] [--subreaper] [--check-lexer] [--serve SOCKET]\n");
+			return 1;
+		}
+	}
+
+	// Command server mode, no prompt
+	if(servePath != NULL)
+		return serveSocket(servePath);
+	startup_phase("options");
+
 	// Set up signals
 	// SIGINT
 	struct sigaction SIGINT_action = {0};
@@ -48,37 +134,95 @@ int main()
 	sigfillset(&SIGTSTP_action.sa_mask);
 	sigaction(SIGTSTP, &SIGTSTP_action, NULL);
 
+	// SIGCHLD, wakes the event loop so queued jobs can start
+	evInit();
+	initNotify();
+	startup_phase("signals");
+
 	// For getting each command's components
 	struct Cmd command;
 
 	// Shell state helpers
 	struct LinkedList bgProcs;
 	initList(&bgProcs);
+	struct CmdQueue bgQueue;
+	initCmdQueue(&bgQueue);
 	pid_t curPid;
 	int childExitMethod;
-	pid_t shellPid = getpid();
+	struct Memo memo;
+	int memoState;
 
 	// Shell status manager
 	struct Status status;
 	initStatus(&status);
+	startup_phase("state");
+
+	// History, only kept for interactive shells
+	int interactive = isatty(STDIN_FILENO);
+	if(interactive)
+		initHistory();
+	startup_phase("history");
+
+	// rc file commands run before the first prompt
+	// Before read ahead starts, as it parses on this thread
+	int fromRc = 0;
+	int readResult = 0;
+	if(useRc)
+		initRc();
+	startup_phase("rc");
+
+	// Scripts are read and parsed ahead on another thread
+	int readingAhead = !interactive && startReadAhead(stdin) == 0;
+	startup_phase("readahead");
+	startup_phase("total");
 
 	// Helper variables
-	int i = 0;
 	char lineBuf[MAX_LINE_SIZE];
-	int result = 0;
 
 	// Loop through until exit
 	while(1)
 	{
 		// Check for background processes
-		check_bg_procs(&bgProcs);
+		check_bg_procs(&bgProcs, &bgQueue);
 
-		// Get next command
-		prompt(lineBuf, MAX_LINE_SIZE);
+		// Get next command, rc file commands first
+		// Those and read ahead commands are already parsed
+		// End of script is the same as exit
+		fromRc = nextRc(&command);
+		if(!fromRc && readingAhead)
+		{
+			outPuts(": ");
+			outFlush();
 
-		// Parse command into struct
-		initCmd(&command);
-		parseCmd(&command, lineBuf);
+			// Slow input doesn't hold up bg processes
+			while((readResult = nextReadAhead(&command)) == -1)
+			{
+				check_bg_procs(&bgProcs, &bgQueue);
+				outFlush();
+			}
+			if(readResult == 0)
+			{
+				serve_watches(&bgProcs, &bgQueue);
+				ss_exit(&bgProcs);
+				break;
+			}
+		}
+		else if(!fromRc)
+		{
+			prompt(lineBuf, MAX_LINE_SIZE, &bgProcs, &bgQueue);
+
+			// Expand !n, !prefix etc, then record
+			if(interactive)
+			{
+				if(expandHistory(lineBuf, MAX_LINE_SIZE) == -1)
+					continue;
+				addHistory(lineBuf);
+			}
+
+			// Parse command into struct
+			initCmd(&command);
+			parseCmd(&command, lineBuf);
+		}
 
 		// If no command given, or it's a comment, go to next prompt
 		if( (command.args[0] == NULL) || (!strcmp("#", command.args[0])) || ('#' == command.args[0][0]) )
@@ -111,104 +255,213 @@ int main()
 			continue;
 		}
 
+		// bgsched
+		if(!strcmp("bgsched", command.args[0]))
+		{
+			bgSchedBuiltin(command.args);
+			destroyCmd(&command);
+			continue;
+		}
+
+		// ulimit
+		// With a command after it, it's a prefix instead
+		if(!strcmp("ulimit", command.args[0]) && !limitHasCommand(command.args))
+		{
+			limitsBuiltin(command.args);
+			destroyCmd(&command);
+			continue;
+		}
+
+		// notify
+		if(!strcmp("notify", command.args[0]))
+		{
+			notifyBuiltin(command.args);
+			destroyCmd(&command);
+			continue;
+		}
+
+		// set
+		if(!strcmp("set", command.args[0]))
+		{
+			ss_set(&command);
+			destroyCmd(&command);
+			continue;
+		}
+
+		// history
+		if(!strcmp("history", command.args[0]))
+		{
+			historyBuiltin(command.args);
+			destroyCmd(&command);
+			continue;
+		}
+
+		// jobs
+		if(!strcmp("jobs", command.args[0]))
+		{
+			ss_jobs(&command, &bgProcs, &bgQueue);
+			destroyCmd(&command);
+			continue;
+		}
+
+		// bgmax
+		if(!strcmp("bgmax", command.args[0]))
+		{
+			ss_bgmax(&command, &bgProcs, &bgQueue);
+			destroyCmd(&command);
+			continue;
+		}
+
+		// dag, status is 1 if any target failed
+		if(!strcmp("dag", command.args[0]))
+		{
+			changeStatus(&status, dagBuiltin(command.args) << 8);
+			destroyCmd(&command);
+			continue;
+		}
+
+		// watch, keeps the command if a watch is started
+		if(!strcmp("watch", command.args[0]))
+		{
+			watchBuiltin(&command, &bgProcs, &bgQueue);
+			destroyCmd(&command);
+			continue;
+		}
+
+		// subreaper
+		if(!strcmp("subreaper", command.args[0]))
+		{
+			subreaperBuiltin(command.args);
+			destroyCmd(&command);
+			continue;
+		}
+
+		// memo, run through the result cache
+		// Background jobs just run, their output can't be replayed
+		memoState = MEMO_OFF;
+		if(!strcmp("memo", command.args[0]))
+		{
+			if(command.args[1] == NULL || command.args[1][0] == '-')
+			{
+				memoBuiltin(command.args);
+				destroyCmd(&command);
+				continue;
+			}
+			shiftCmd(&command, 1);
+			memoState = command.bgProc ? MEMO_OFF : MEMO_MISS;
+		}
+
+		// Strip launch prefixes (nice, ionice, cpuset, ulimit)
+		if(ss_prefixes(&command) == -1)
+		{
+			destroyCmd(&command);
+			continue;
+		}
+
+		// Background processes get the shell-wide policy for anything not given
+		if(command.bgProc && bgSchedOn)
+			mergeSched(&command.sched, &bgSchedDefault);
+
+		// All processes get the shell-wide limits for anything not given
+		mergeLimits(&command.limits, &jobLimitDefault);
+
+		// Too many background processes running, wait for one to finish
+		// Queue owns the command until it's launched from check_bg_procs()
+		if(command.bgProc && bgMax > 0 && getSize(&bgProcs) >= bgMax)
+		{
+			pushCmdQueue(&bgQueue, &command);
+			outPrintf("background job queued (%d waiting)\n", getCmdQueueSize(&bgQueue));
+			continue;
+		}
+
+		// cat of files is copied in the shell, no fork needed
+		if(!strcmp("cat", command.args[0]) && (childExitMethod = catBuiltin(&command)) != -1)
+		{
+			changeStatus(&status, childExitMethod);
+			if(wasSignalTerm(&status))
+				printStatus(&status);
+			destroyCmd(&command);
+			continue;
+		}
+
+		// Cached result replayed, no fork needed
+		if(memoState == MEMO_MISS)
+			memoState = memoStart(&command, &memo, &childExitMethod);
+		if(memoState == MEMO_HIT)
+		{
+			changeStatus(&status, childExitMethod);
+			destroyCmd(&command);
+			continue;
+		}
+
 		// Command requested not overridden in smallsh
 		// Proceed to pass to fork()
-		curPid = fork();
-		result = 0;
+		curPid = ss_spawn(&command);
 
-		switch(curPid)
+		// Couldn't fork, command fails without running
+		if(curPid == -1)
 		{
-			// Error with spawning process
-			case -1:
-				perror("ERROR: Spawn Error\n");
-				exit(1);
-				break;
-			// CHILD PROCESS
-			case 0:
-				// SIGINT Updates
-				// Update signal handler for foreground processes
-				if(command.bgProc)
-					SIGINT_action.sa_handler = SIG_IGN;
-				else
-					SIGINT_action.sa_handler = SIG_DFL;
-
-				sigfillset(&SIGINT_action.sa_mask);
-				sigaction(SIGINT, &SIGINT_action, NULL);
-
-				// SIGTSTP Updates
-				SIGTSTP_action.sa_handler = SIG_IGN;
-				sigaction(SIGTSTP, &SIGTSTP_action, NULL);
-
-				// Redirection Setup
-				// Use bitwise OR to amass any error messages into result
-				if(command.redirStdout)
-					result |= ss_redir_stdout(command.stdoutFile);
-				else if(command.bgProc)
-					result |= ss_redir_stdout("/dev/null");
-				if(command.redirStdin)
-					result |= ss_redir_stdin(command.stdinFile);
-				else if(command.bgProc)
-					result |= ss_redir_stdin("/dev/null");
-
-				// If any errors were made, exit
-				if(result) exit(1);
-
-				// EXEC!
-				execvp(command.args[0], command.args); 
-				
-				// If here, problem with exec()
-				printf("%s: no such file or directory\n", command.args[0]);
-				fflush(stdout);
-				destroyCmd(&command);
-				exit(1);
-				break;
-			// PARENT PROCESS
-			default:
-				// If it's a background process
-				if(command.bgProc)
-				{
-					printf("background pid is %d\n", (int)curPid);
-					fflush(stdout);
-
-					// Add to bg process linked list
-					pushList(&bgProcs, curPid);
-				}
-				// Otherwise it's a foreground process
-				else
-				{
-					// Set up mask to block SIGTSTP
-					sigset_t signal;
-					sigemptyset(&signal);
-					sigaddset(&signal, SIGTSTP);
-
-					// Use sigprocmask while waiting
-					sigprocmask(SIG_BLOCK, &signal, NULL);
-					int result = -1;
-
-					// Loop keeping waiting in case waitpid returns error
-					// This fixes problem with waitpid errors resulting in zombies
-					while(result == -1)
-					{
-						result = waitpid(curPid, &childExitMethod, 0);
-					}
-				
-					// remove mask
-					sigprocmask(SIG_UNBLOCK, &signal, NULL);
-
-					// Update status and print messages accordingly
-					changeStatus(&status, childExitMethod);
-					if(wasSignalTerm(&status))
-						printStatus(&status);
-				}
-
-				// Clean up
-				destroyCmd(&command);
-				break;
+			outPrintf("smallsh: cannot fork: %s\n", strerror(errno));
+			if(memoState == MEMO_MISS)
+				memoCancel(&memo);
+			changeStatus(&status, 1 << 8);
 		}
+		// If it's a background process
+		else if(command.bgProc)
+		{
+			outPrintf("background pid is %d\n", (int)curPid);
+
+			// Add to bg process linked list
+			pushList(&bgProcs, curPid);
+		}
+		// Otherwise it's a foreground process
+		else
+		{
+			// Set up mask to block SIGTSTP
+			sigset_t signal;
+			sigemptyset(&signal);
+			sigaddset(&signal, SIGTSTP);
+
+			// Use sigprocmask while waiting
+			sigprocmask(SIG_BLOCK, &signal, NULL);
+			int result = -1;
+
+			// Forward any fanned out output until it's done
+			fanoutWait(curPid);
+
+			// Loop keeping waiting in case waitpid returns error
+			// This fixes problem with waitpid errors resulting in zombies
+			while(result == -1)
+			{
+				result = waitpid(curPid, &childExitMethod, 0);
+			}
+
+			// remove mask
+			sigprocmask(SIG_UNBLOCK, &signal, NULL);
+
+			// Output was captured for the cache
+			if(memoState == MEMO_MISS)
+				memoFinish(&memo, childExitMethod);
+
+			// Update status and print messages accordingly
+			changeStatus(&status, childExitMethod);
+			if(wasSignalTerm(&status))
+				printStatus(&status);
+		}
+
+		// Clean up
+		destroyCmd(&command);
 	}
 	
-	// Clean up bg process linked list at end of program
+	// Clean up bg process linked list and queue at end of program
 	freeList(&bgProcs);
+	freeCmdQueue(&bgQueue);
+	freeReaper();
+	freeWatches();
+	freeRc();
+	freeHistory();
+	freeCompletion();
+	outFlush();
 	
 	return 0;
 }
@@ -219,27 +472,81 @@ int main()
 
 /*
  * COMMAND LINE PROMPT
+ * Uses the line editor when talking to a terminal
  * */
-void prompt(char * line, const int LINE_SIZE)
+void prompt(char * line, const int LINE_SIZE, struct LinkedList * procs, struct CmdQueue * queue)
 {
 	// Helper variables
 	int charsInput = -2;
 	char * newLine = NULL;
 	size_t bufferSize = 0;
+	int showPrompt = 1;
+	int useEditor = isatty(STDIN_FILENO) && isatty(STDOUT_FILENO);
 
 	// Prompt for next command
 	// In loop to account for signal interrupts
 	while(1)
 	{
-		printf(": ");
-		fflush(stdout);
+		// Prompt goes out with any messages queued since the last one
+		if(showPrompt && !useEditor)
+			outPuts(": ");
+		outFlush();
 
 		// Get newline, checking for errors
-		charsInput = getline(&newLine, &bufferSize, stdin);
-		if (charsInput == -1)
-			clearerr(stdin);
+		sigintSignaled = 0;
+		if(useEditor)
+		{
+			charsInput = editLine(": ", showPrompt, line, LINE_SIZE);
+
+			// ^D on empty line exits, like other shells
+			if(charsInput == EDIT_EOF)
+			{
+				strcpy(line, "exit\n");
+				return;
+			}
+			if(charsInput >= 0)
+				return;
+		}
 		else
-			break;
+		{
+			// A terminal hands over one line per read, so nothing sits
+			// in stdin's buffer and polling the fd is enough
+			charsInput = -1;
+			if(!isatty(STDIN_FILENO) || evWaitReadable(STDIN_FILENO) == 0)
+				charsInput = getline(&newLine, &bufferSize, stdin);
+			if (charsInput != -1)
+				break;
+			clearerr(stdin);
+		}
+		showPrompt = 1;
+
+		// ^C throws away the line being edited
+		if(sigintSignaled)
+			editDiscard();
+
+		// A bg process finished while notices wait for the prompt
+		// Queued jobs start in its place, anything else waits
+		else if(childSignaled && !notifySignaled)
+		{
+			childSignaled = 0;
+			showPrompt = 0;
+			if(getCmdQueueSize(queue) > 0)
+			{
+				outPuts("\n");
+				check_bg_procs(procs, queue);
+				showPrompt = 1;
+			}
+		}
+
+		// Interrupted for bg process notices
+		// Only redraw prompt if anything was printed
+		else if(notifySignaled)
+		{
+			notifySignaled = 0;
+			notifyBeginAsync();
+			check_bg_procs(procs, queue);
+			showPrompt = notifyEndAsync();
+		}
 	}
 
 	// Assign to memory allocated, and free buffer
@@ -249,9 +556,52 @@ void prompt(char * line, const int LINE_SIZE)
 	newLine = NULL;
 }
 
+/*
+ * SERVE WATCHES AT END OF SCRIPT
+ * A script that starts watches keeps running them until it's killed,
+ * in place of a while sleep loop
+ * */
+void serve_watches(struct LinkedList * procs, struct CmdQueue * queue)
+{
+	while(watchCount() > 0)
+	{
+		outFlush();
+		evRunOnce(-1);
+		check_bg_procs(procs, queue);
+	}
+}
+
+/*
+ * STARTUP PROFILE
+ * Prints microseconds since the last phase, with --startup-profile
+ * NULL marks the start, "total" prints time since then
+ * */
+void startup_phase(const char * name)
+{
+	static struct timespec begin, last;
+	struct timespec now;
+	struct timespec * from = &last;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	if(name == NULL)
+	{
+		begin = last = now;
+		return;
+	}
+	if(!strcmp("total", name))
+		from = &begin;
+
+	if(startupProfile)
+		fprintf(stderr, "startup: %-10s %8ld us\n", name,
+				(now.tv_sec - from->tv_sec) * 1000000 + (now.tv_nsec - from->tv_nsec) / 1000);
+
+	last = now;
+}
+
 /*
  * EXIT SMALLSH
  * Clean up any background processes still running
+ * In subreaper mode, that's everything descended from the shell
  * */
 void ss_exit(struct LinkedList * procs)
 {
@@ -264,6 +614,10 @@ void ss_exit(struct LinkedList * procs)
 	{
 		kill(listIterNext(&iter), SIGTERM);
 	}
+
+	// Then whatever they started, if it can be found
+	if(isSubreaper())
+		shutdownTree(procs);
 }
 
 /*
@@ -285,77 +639,81 @@ void ss_cd(struct Cmd * command)
 }
 
 /*
- * REDIRECT STDIN FILE DESCRIPTOR
+ * SET MAX BACKGROUND PROCESSES
+ * bgmax        show max, running and queued
+ * bgmax N      set max, 0 for no max
  * */
-int ss_redir_stdin(char * file)
+void ss_bgmax(struct Cmd * command, struct LinkedList * procs, struct CmdQueue * queue)
 {
-	// Helper variables
-	int sourceFD, result;
+	char * end = NULL;
+	long val;
 
-	// Open new file descriptor
-	sourceFD = open(file, O_RDONLY);
-
-	// If error in opening
-	if (sourceFD == -1)
+	// No args, show current state
+	if(command->args[1] == NULL)
 	{
-		printf("cannot open %s for input\n", file);
-		fflush(stdout);
-		return -1;
+		outPrintf("bgmax %d (%d running, %d queued)\n", bgMax, getSize(procs), getCmdQueueSize(queue));
+		return;
 	}
 
-	// Assign file descriptor to new location
-	result = dup2(sourceFD, 0);
-
-	// If error in reassigning
-	if (result == -1)
+	val = strtol(command->args[1], &end, 10);
+	if(*end != '\0' || end == command->args[1] || val < 0)
 	{
-		printf("cannot redirect to %s for output\n", file);
-		fflush(stdout);
-		return -1;
+		outPrintf("bgmax: invalid number %s\n", command->args[1]);
+		return;
 	}
 
-	// otherwise return success
-	return 0;
+	// Any queued processes that now fit are launched at the next prompt
+	bgMax = (int)val;
 }
 
 /*
- * REDIRECT STDOUT FILE DESCRIPTOR
+ * LIST BACKGROUND PROCESSES
+ * jobs         show running, queued and finished processes
+ * jobs -c      clear finished processes
  * */
-int ss_redir_stdout(char * file)
+void ss_jobs(struct Cmd * command, struct LinkedList * procs, struct CmdQueue * queue)
 {
-	// Helper variables
-	int targetFD, result;
-
-	// Open new file descriptor
-	targetFD = open(file, O_WRONLY | O_CREAT | O_TRUNC, 0644);
-
-	// If error in opening
-	if (targetFD == -1)
+	if(command->args[1] != NULL && !strcmp("-c", command->args[1]))
 	{
-		printf("cannot open %s for output\n", file);
-		fflush(stdout);
-		return -1;
+		clearDoneJobs();
+		return;
 	}
 
-	// Assign file descriptor to new location
-	result = dup2(targetFD, 1);
+	outPrintf("running: ");
+	printList(procs);
+	printAdopted();
+	printWatches();
+	if(getCmdQueueSize(queue) > 0)
+		outPrintf("queued: %d\n", getCmdQueueSize(queue));
+	printDoneJobs();
+}
 
-	// If error in reassigning
-	if (result == -1)
+/*
+ * SET SHELL OPTIONS
+ * set -b       notify immediately when bg processes finish
+ * set +b       notify before next prompt
+ * */
+void ss_set(struct Cmd * command)
+{
+	char * notifyArgs[3] = { "notify", NULL, NULL };
+
+	if(command->args[1] != NULL && !strcmp("-b", command->args[1]))
+		notifyArgs[1] = "immediate";
+	else if(command->args[1] != NULL && !strcmp("+b", command->args[1]))
+		notifyArgs[1] = "prompt";
+	else
 	{
-		printf("cannot redirect to %s for output\n", file);
-		fflush(stdout);
-		return -1;
+		outPrintf("set: unsupported option %s\n", command->args[1] ? command->args[1] : "");
+		return;
 	}
-	
-	// Otherwise return success
-	return 0;
+
+	notifyBuiltin(notifyArgs);
 }
 
 /*
- * CHECK FOR COMPLETED BACKGROUND PROCESSES
+ * REAP COMPLETED PROCESSES IN LIST
  * */
-void check_bg_procs(struct LinkedList * procs)
+void reap_procs(struct LinkedList * procs)
 {
 	// Initialize iterator
 	struct ListIter iter;
@@ -367,39 +725,28 @@ void check_bg_procs(struct LinkedList * procs)
 
 	// Helper variables
 	int childExitMethod = -5;
+	pid_t pid = -5;
 	pid_t childPid = -5;
-	int exitStatus, signo;
 
 	// Check current elements
 	while(listIterHasNext(&iter))
 	{
-		childPid = waitpid(listIterNext(&iter), &childExitMethod, WNOHANG);
+		pid = listIterNext(&iter);
+		childPid = waitpid(pid, &childExitMethod, WNOHANG);
 
 		// If child process receives value, means it has completed
-		if(childPid)
+		if(childPid > 0)
 		{
 			// Add it to list to remove
 			pushList(&toRemove, childPid);
 
-			// Print message
-			printf("background pid %d is done: ", (int)childPid);
-			fflush(stdout);
-
-			// Include message with status
-			// Normal termination:
-			if (WIFEXITED(childExitMethod))
-			{
-				exitStatus = WEXITSTATUS(childExitMethod);
-				printf("exit value %d\n", exitStatus);
-				fflush(stdout);
-			}
-			// Signal termination
-			else if (WIFSIGNALED(childExitMethod))
-			{
-				signo = WTERMSIG(childExitMethod);
-				printf("terminated by signal %d\n", signo);
-				fflush(stdout);
-			}
+			// Notice depends on notify mode
+			notifyJobDone(childPid, childExitMethod);
+		}
+		// Not our child anymore, nothing to report
+		else if(childPid == -1)
+		{
+			pushList(&toRemove, pid);
 		}
 	}
 	
@@ -413,3 +760,44 @@ void check_bg_procs(struct LinkedList * procs)
 	// Free linked list when done
 	freeList(&toRemove);
 }
+
+/*
+ * CHECK FOR COMPLETED BACKGROUND PROCESSES
+ * Orphans adopted in subreaper mode are reaped the same way
+ * Anything ready in the event loop (bg output, watches) is served too,
+ * so it keeps moving between script lines
+ * */
+void check_bg_procs(struct LinkedList * procs, struct CmdQueue * queue)
+{
+	pid_t childPid = -5;
+
+	evRunOnce(0);
+
+	reap_procs(procs);
+	adoptOrphans(procs);
+	reap_procs(&adoptedProcs);
+
+	// Launch queued processes while there's room
+	struct Cmd command;
+	CmdLaunched launched = NULL;
+	int tag = 0;
+	while( (bgMax == 0 || getSize(procs) < bgMax) && popCmdQueueHook(queue, &command, &launched, &tag) )
+	{
+		childPid = ss_spawn(&command);
+		destroyCmd(&command);
+		if(childPid == -1)
+			outPrintf("smallsh: cannot fork queued job: %s\n", strerror(errno));
+		else
+		{
+			outPrintf("background pid is %d\n", (int)childPid);
+			pushList(procs, childPid);
+		}
+
+		// Whoever queued it tracks it from here, or learns it failed
+		if(launched != NULL)
+			launched(childPid, tag);
+	}
+
+	// Summary notice, if one is due
+	notifyFlush();
+}
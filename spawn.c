@@ -0,0 +1,213 @@
+/*
+ * SPAWN IMPLEMENTATION FILE
+ *
+ * Launching commands: fork, child setup (signals, scheduling,
+ * redirection, limits) and exec
+ * */
+
+// Header files
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <signal.h>
+#include <fcntl.h>
+#include "spawn.h"
+#include "fanout.h"
+#include "output.h"
+#include "reaper.h"
+
+/*
+ * SPAWN COMMAND
+ * Forks, sets up the child and execs the command
+ * Returns child's pid to the parent, or -1 with errno set if fork failed
+ * */
+pid_t ss_spawn(struct Cmd * command)
+{
+	// Helper variables
+	pid_t curPid = -5;
+	int result = 0;
+	struct sigaction SIGINT_action = {0};
+	struct sigaction SIGTSTP_action = {0};
+	sigset_t mask;
+
+	// Write queued messages first, so they aren't duplicated in the child
+	// or shown out of order with the child's output
+	outFlush();
+
+	// Several outputs, shell forwards them from a pipe
+	if(needsFanout(command) && fanoutOpen(command) == -1)
+		outPrintf("cannot create pipe for output\n");
+
+	curPid = fork();
+
+	switch(curPid)
+	{
+		// Error with spawning process, caller reports it
+		case -1:
+			result = errno;
+			fanoutAttach(-1);
+			errno = result;
+			return -1;
+		// CHILD PROCESS
+		case 0:
+			// SIGINT Updates
+			// Update signal handler for foreground processes
+			if(command->bgProc)
+				SIGINT_action.sa_handler = SIG_IGN;
+			else
+				SIGINT_action.sa_handler = SIG_DFL;
+
+			sigfillset(&SIGINT_action.sa_mask);
+			sigaction(SIGINT, &SIGINT_action, NULL);
+
+			// SIGTSTP Updates
+			SIGTSTP_action.sa_handler = SIG_IGN;
+			sigaction(SIGTSTP, &SIGTSTP_action, NULL);
+
+			// Don't pass on any signals the shell has blocked
+			sigemptyset(&mask);
+			sigprocmask(SIG_SETMASK, &mask, NULL);
+
+			// Scheduling Setup
+			if(applySched(&command->sched)) exit(1);
+
+			// Redirection Setup
+			// Use bitwise OR to amass any error messages into result
+			// Files named in the command win over fds handed to it
+			if(command->redirStdout)
+				result |= ss_redir_stdout(command->stdoutFile, command->stdoutAppend);
+			else if(command->stdoutFd != -1)
+				result |= (dup2(command->stdoutFd, 1) == -1) ? -1 : 0;
+			else if(command->bgProc)
+				result |= ss_redir_stdout("/dev/null", 0);
+			if(command->redirStdin)
+				result |= ss_redir_stdin(command->stdinFile);
+			else if(command->stdinFd != -1)
+				result |= (dup2(command->stdinFd, 0) == -1) ? -1 : 0;
+			else if(command->bgProc)
+				result |= ss_redir_stdin("/dev/null");
+
+			// If any errors were made, exit
+			if(result) exit(1);
+
+			// Limits Setup
+			// After redirection, so a low open file limit can't block it
+			if(applyLimits(&command->limits)) exit(1);
+
+			// Environment just for this command
+			if(command->setEnv != NULL)
+				putenv(command->setEnv);
+
+			// EXEC!
+			execvp(command->args[0], command->args); 
+			
+			// If here, problem with exec()
+			outPrintf("%s: no such file or directory\n", command->args[0]);
+			destroyCmd(command);
+			exit(1);
+			break;
+	}
+
+	// PARENT PROCESS
+	fanoutAttach(curPid);
+	noteSpawned(curPid);
+	return curPid;
+}
+
+/*
+ * STRIP LAUNCH PREFIXES
+ * Removes any leading "nice N", "ionice CLASS", "cpuset LIST"
+ * or "ulimit OPTS" from the command, storing them in the command's options
+ * Returns -1 on a malformed prefix or missing command
+ * */
+int ss_prefixes(struct Cmd * command)
+{
+	int used = 0;		// Words used by current prefix
+	int stripped = 0;	// Were any prefixes found
+
+	while((used = parseSchedPrefix(command->args, &command->sched)) != 0
+			|| (used = parseLimitPrefix(command->args, &command->limits)) != 0)
+	{
+		if(used == -1)
+			return -1;
+
+		shiftCmd(command, used);
+		stripped = 1;
+	}
+
+	// Prefixes need a command to apply to
+	if(stripped && command->args[0] == NULL)
+	{
+		outPrintf("missing command after prefix\n");
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * REDIRECT STDIN FILE DESCRIPTOR
+ * */
+int ss_redir_stdin(char * file)
+{
+	// Helper variables
+	int sourceFD, result;
+
+	// Open new file descriptor
+	sourceFD = open(file, O_RDONLY);
+
+	// If error in opening
+	if (sourceFD == -1)
+	{
+		outPrintf("cannot open %s for input\n", file);
+		return -1;
+	}
+
+	// Assign file descriptor to new location
+	result = dup2(sourceFD, 0);
+
+	// If error in reassigning
+	if (result == -1)
+	{
+		outPrintf("cannot redirect to %s for output\n", file);
+		return -1;
+	}
+
+	// otherwise return success
+	return 0;
+}
+
+/*
+ * REDIRECT STDOUT FILE DESCRIPTOR
+ * Appends for >>
+ * */
+int ss_redir_stdout(char * file, int append)
+{
+	// Helper variables
+	int targetFD, result;
+
+	// Open new file descriptor
+	targetFD = open(file, O_WRONLY | O_CREAT | (append ? O_APPEND : O_TRUNC), 0644);
+
+	// If error in opening
+	if (targetFD == -1)
+	{
+		outPrintf("cannot open %s for output\n", file);
+		return -1;
+	}
+
+	// Assign file descriptor to new location
+	result = dup2(targetFD, 1);
+
+	// If error in reassigning
+	if (result == -1)
+	{
+		outPrintf("cannot redirect to %s for output\n", file);
+		return -1;
+	}
+	
+	// Otherwise return success
+	return 0;
+}
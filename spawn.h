@@ -0,0 +1,21 @@
+/*
+ * SPAWN HEADER FILE
+ *
+ * Launching commands: fork, child setup (signals, scheduling,
+ * redirection, limits) and exec
+ * */
+
+#ifndef SPAWN_H
+#define SPAWN_H
+
+// Header files
+#include <unistd.h>
+#include "cmd.h"
+
+// Function prototypes
+pid_t ss_spawn(struct Cmd * command);			// Fork and exec, returns child pid or -1
+int ss_prefixes(struct Cmd * command);			// Strip launch prefixes into command
+int ss_redir_stdin(char * file);				// Redirect stdin from file
+int ss_redir_stdout(char * file, int append);	// Redirect stdout to file
+
+#endif
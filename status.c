@@ -8,6 +8,7 @@
 #include <unistd.h>
 #include <sys/wait.h>
 #include "status.h"
+#include "output.h"
 
 /*
  * INITIALIZE STATUS STRUCT
@@ -46,13 +47,11 @@ void printStatus(struct Status * status)
 	// Print current status message depending on most recent type of status
 	if(status->normalTerm)
 	{
-		printf("exit value %d\n", status->value);
-		fflush(stdout);
+		outPrintf("exit value %d\n", status->value);
 	}
 	else
 	{
-		printf("terminated by signal %d\n", status->value);
-		fflush(stdout);
+		outPrintf("terminated by signal %d\n", status->value);
 	}
 }
 
@@ -0,0 +1,786 @@
+/*
+ * WATCH IMPLEMENTATION FILE
+ *
+ * Re-run a command when files change
+ * Each watch has an inotify fd for its paths and a timerfd for the
+ * debounce, both in the event loop, which the shell serves at the
+ * prompt, between script lines and while waiting on foreground jobs.
+ * Changes are collected until the timer goes off with no new ones,
+ * then the command is started as a background job, tracked with a
+ * pidfd so a queued run can follow it as soon as it exits. A cancelled
+ * run that ignores SIGTERM gets SIGKILL after the reaper's grace
+ * period, on a second timerfd. Reaping is left to the job table.
+ *
+ * Files are watched through their directory, so editors that save by
+ * writing a new file and renaming it over the old one are still seen.
+ *
+ * Exit Error 20 indicates error with malloc
+ * */
+
+// Header files
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/syscall.h>
+#include <sys/inotify.h>
+#include <sys/timerfd.h>
+#include "watch.h"
+#include "spawn.h"
+#include "eventLoop.h"
+#include "output.h"
+#include "reaper.h"
+
+// Events that count as a change
+#define WATCH_MASK (IN_MODIFY | IN_CLOSE_WRITE | IN_ATTRIB | IN_CREATE | IN_DELETE \
+		| IN_MOVED_FROM | IN_MOVED_TO)
+
+// Global background scheduling policy
+// Comes from jobSched.h library
+extern int bgSchedOn;
+extern struct SchedOpts bgSchedDefault;
+
+// Global resource limits for all jobs
+// Comes from jobLimits.h library
+extern struct JobLimits jobLimitDefault;
+
+// Max number of background processes running at once
+// Comes from smallsh.c
+extern int bgMax;
+
+// One inotify watch
+struct WatchPath
+{
+	int wd;							// Watch descriptor, -1 once removed
+	char * path;					// Directory watched
+	char * name;					// Only this entry in it, or NULL for all
+};
+
+// One watch builtin
+struct Watch
+{
+	int id;
+	int inFd;						// inotify
+	int timerFd;					// Debounce
+	int killFd;						// SIGKILL after a cancel is ignored
+	int pidFd;						// Run in flight, or -1
+	struct WatchPath * paths;
+	int numPaths;
+	int capPaths;
+	int recursive;					// Watch new subdirectories too
+	int policy;						// WATCH_QUEUE or WATCH_CANCEL
+	long debounceMs;
+	int changing;					// Timer armed
+	struct timespec firstChange;	// Start of this burst
+	char ** changed;				// Paths for next run
+	int numChanged;
+	pid_t pid;						// Run in flight, or 0
+	int queued;						// Run waiting in bg queue
+	int pending;					// Run again when it's done
+	int cancelled;					// SIGTERM already sent
+	struct Cmd cmd;					// Command run
+	struct LinkedList * procs;		// Job table runs go in
+	struct CmdQueue * queue;		// Where runs wait for bgmax
+	struct Watch * next;
+};
+
+// Active watches
+static struct Watch * watches = NULL;
+static int nextId = 1;
+
+static void onRunExit(int fd, void * data);
+
+/*
+ * JOIN DIRECTORY AND NAME
+ * Names in the current directory are left as they are
+ * */
+static char * joinPath(const char * dir, const char * name)
+{
+	size_t size = strlen(dir) + strlen(name) + 2;
+	char * path = malloc(size);
+	if(path == NULL) exit(20);
+
+	if(!strcmp(".", dir))
+	{
+		strcpy(path, name);
+		return path;
+	}
+
+	snprintf(path, size, "%s/%s", dir, name);
+	return path;
+}
+
+/*
+ * COPY STRING
+ * */
+static char * copyString(const char * str)
+{
+	char * copy = malloc(strlen(str) + 1);
+	if(copy == NULL) exit(20);
+
+	strcpy(copy, str);
+	return copy;
+}
+
+/*
+ * WATCH DIRECTORY, OR ONE ENTRY IN IT
+ * Returns -1 if inotify refuses it
+ * */
+static int watchDir(struct Watch * w, const char * dir, const char * name)
+{
+	int wd = inotify_add_watch(w->inFd, dir, WATCH_MASK);
+
+	if(wd == -1)
+		return -1;
+
+	if(w->numPaths == w->capPaths)
+	{
+		w->capPaths = w->capPaths ? w->capPaths * 2 : 8;
+		w->paths = realloc(w->paths, sizeof(struct WatchPath) * w->capPaths);
+		if(w->paths == NULL) exit(20);
+	}
+
+	w->paths[w->numPaths].wd = wd;
+	w->paths[w->numPaths].path = copyString(dir);
+	w->paths[w->numPaths].name = name ? copyString(name) : NULL;
+	w->numPaths++;
+	return 0;
+}
+
+/*
+ * WATCH DIRECTORY AND, IF RECURSIVE, ALL BELOW IT
+ * Returns -1 if the top directory can't be watched
+ * */
+static int watchTree(struct Watch * w, const char * dir)
+{
+	DIR * stream = NULL;
+	struct dirent * entry = NULL;
+	struct stat info;
+	char * sub = NULL;
+	int isDir = 0;
+
+	if(watchDir(w, dir, NULL) == -1)
+		return -1;
+	if(!w->recursive || (stream = opendir(dir)) == NULL)
+		return 0;
+
+	while((entry = readdir(stream)) != NULL)
+	{
+		if(!strcmp(".", entry->d_name) || !strcmp("..", entry->d_name))
+			continue;
+
+		// Symlinks aren't followed, so loops can't happen
+		sub = joinPath(dir, entry->d_name);
+		isDir = entry->d_type == DT_DIR;
+		if(entry->d_type == DT_UNKNOWN)
+			isDir = lstat(sub, &info) == 0 && S_ISDIR(info.st_mode);
+		if(isDir)
+			watchTree(w, sub);
+		free(sub);
+	}
+
+	closedir(stream);
+	return 0;
+}
+
+/*
+ * WATCH ONE PATH GIVEN TO BUILTIN
+ * Returns -1 if it doesn't exist or can't be watched
+ * */
+static int watchPath(struct Watch * w, char * path)
+{
+	struct stat info;
+	char * slash = NULL;
+	char * dir = NULL;
+	int result = 0;
+
+	if(stat(path, &info) == -1)
+		return -1;
+	if(S_ISDIR(info.st_mode))
+		return watchTree(w, path);
+
+	// Files through their directory
+	slash = strrchr(path, '/');
+	if(slash == NULL)
+		return watchDir(w, ".", path);
+
+	dir = copyString(path);
+	dir[slash - path] = '\0';
+	result = watchDir(w, slash == path ? "/" : dir, slash + 1);
+	free(dir);
+	return result;
+}
+
+/*
+ * ADD TO PATHS FOR NEXT RUN
+ * Repeats are dropped, as are paths past the limit
+ * */
+static void noteChange(struct Watch * w, char * path)
+{
+	int i = 0;
+
+	if(w->numChanged == WATCH_MAX_CHANGED)
+	{
+		free(path);
+		return;
+	}
+	for(i = 0; i < w->numChanged; i++)
+	{
+		if(!strcmp(w->changed[i], path))
+		{
+			free(path);
+			return;
+		}
+	}
+
+	if(w->changed == NULL)
+	{
+		w->changed = malloc(sizeof(char *) * WATCH_MAX_CHANGED);
+		if(w->changed == NULL) exit(20);
+	}
+	w->changed[w->numChanged++] = path;
+}
+
+/*
+ * RESTART DEBOUNCE TIMER
+ * A burst that never goes quiet still runs after WATCH_MAX_DEBOUNCES periods
+ * */
+static void armTimer(struct Watch * w)
+{
+	struct itimerspec spec;
+	struct timespec now;
+	long elapsedMs = 0;
+	long delayMs = w->debounceMs;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	if(!w->changing)
+	{
+		w->firstChange = now;
+		w->changing = 1;
+	}
+
+	elapsedMs = (now.tv_sec - w->firstChange.tv_sec) * 1000
+		+ (now.tv_nsec - w->firstChange.tv_nsec) / 1000000;
+	if(elapsedMs + delayMs > w->debounceMs * WATCH_MAX_DEBOUNCES)
+		delayMs = w->debounceMs * WATCH_MAX_DEBOUNCES - elapsedMs;
+	if(delayMs < 1)
+		delayMs = 1;
+
+	memset(&spec, 0, sizeof(spec));
+	spec.it_value.tv_sec = delayMs / 1000;
+	spec.it_value.tv_nsec = (delayMs % 1000) * 1000000;
+	timerfd_settime(w->timerFd, 0, &spec, NULL);
+}
+
+/*
+ * TRACK RUN THAT'S BEEN LAUNCHED
+ * */
+static void trackRun(struct Watch * w, pid_t pid)
+{
+	w->pid = pid;
+
+	// Exit shows up as a readable pidfd
+#ifdef SYS_pidfd_open
+	w->pidFd = syscall(SYS_pidfd_open, pid, 0);
+#endif
+	if(w->pidFd != -1)
+		evAdd(w->pidFd, onRunExit, w);
+}
+
+/*
+ * QUEUED RUN LAUNCHED
+ * Called from the bg queue, with -1 if fork failed
+ * The watch may be gone by now
+ * */
+static void onLaunched(pid_t pid, int id)
+{
+	struct Watch * w = NULL;
+
+	for(w = watches; w != NULL; w = w->next)
+	{
+		if(w->id == id)
+		{
+			w->queued = 0;
+			if(pid != -1)
+				trackRun(w, pid);
+			return;
+		}
+	}
+}
+
+/*
+ * START RUN WITH CHANGES SO FAR
+ * Changed paths go in the environment, one per line
+ * Waits in the bg queue if bgmax processes are already running
+ * */
+static void startRun(struct Watch * w)
+{
+	struct Cmd run = w->cmd;
+	size_t size = strlen(WATCH_ENV) + 2;
+	pid_t pid = 0;
+	int i = 0;
+
+	// Own copy, a queued run outlives the watch's command
+	run.args = malloc(sizeof(char *) * (w->cmd.numArgs + 1));
+	if(run.args == NULL) exit(20);
+	for(i = 0; i < w->cmd.numArgs; i++)
+		run.args[i] = copyString(w->cmd.args[i]);
+	run.args[w->cmd.numArgs] = NULL;
+
+	for(i = 0; i < w->numChanged; i++)
+		size += strlen(w->changed[i]) + 1;
+	run.setEnv = malloc(size);
+	if(run.setEnv == NULL) exit(20);
+	strcpy(run.setEnv, WATCH_ENV "=");
+	for(i = 0; i < w->numChanged; i++)
+	{
+		if(i > 0)
+			strcat(run.setEnv, "\n");
+		strcat(run.setEnv, w->changed[i]);
+	}
+
+	// Same defaults as any other background job
+	if(bgSchedOn)
+		mergeSched(&run.sched, &bgSchedDefault);
+	mergeLimits(&run.limits, &jobLimitDefault);
+
+	if(bgMax > 0 && getSize(w->procs) >= bgMax)
+	{
+		outPrintf("watch %d: %d changed, run queued\n", w->id, w->numChanged);
+		pushCmdQueueHook(w->queue, &run, onLaunched, w->id);
+		w->queued = 1;
+	}
+	else
+	{
+		outPrintf("watch %d: %d changed, running %s\n", w->id, w->numChanged, run.args[0]);
+		pid = ss_spawn(&run);
+		destroyCmd(&run);
+		if(pid == -1)
+			outPrintf("watch %d: cannot fork: %s\n", w->id, strerror(errno));
+		else
+		{
+			trackRun(w, pid);
+			pushList(w->procs, pid);
+		}
+	}
+
+	for(i = 0; i < w->numChanged; i++)
+		free(w->changed[i]);
+	w->numChanged = 0;
+}
+
+/*
+ * STOP SIGKILL TIMER
+ * */
+static void disarmKill(struct Watch * w)
+{
+	struct itimerspec spec;
+
+	memset(&spec, 0, sizeof(spec));
+	if(w->killFd != -1)
+		timerfd_settime(w->killFd, 0, &spec, NULL);
+}
+
+/*
+ * CANCEL RUN IN FLIGHT
+ * SIGTERM now, SIGKILL if it's still going after the reaper's grace period
+ * */
+static void cancelRun(struct Watch * w)
+{
+	struct itimerspec spec;
+	long graceMs = getReaperGrace();
+
+	kill(w->pid, SIGTERM);
+	w->cancelled = 1;
+
+	memset(&spec, 0, sizeof(spec));
+	spec.it_value.tv_sec = graceMs / 1000;
+	spec.it_value.tv_nsec = (graceMs % 1000) * 1000000;
+	if(graceMs < 1)
+		spec.it_value.tv_nsec = 1;
+	if(w->killFd != -1)
+		timerfd_settime(w->killFd, 0, &spec, NULL);
+}
+
+/*
+ * RUN IN FLIGHT IS DONE
+ * */
+static void endRun(struct Watch * w)
+{
+	if(w->pidFd != -1)
+	{
+		evRemove(w->pidFd);
+		close(w->pidFd);
+	}
+
+	w->pidFd = -1;
+	w->pid = 0;
+	w->cancelled = 0;
+	disarmKill(w);
+}
+
+/*
+ * RUN EXITED, START QUEUED ONE
+ * */
+static void onRunExit(int fd, void * data)
+{
+	struct Watch * w = data;
+
+	(void)fd;
+	endRun(w);
+	if(w->pending)
+	{
+		w->pending = 0;
+		startRun(w);
+	}
+}
+
+/*
+ * HAS PROCESS EXITED
+ * Without a pidfd, checked when the timer goes off
+ * Leaves it for the job table to reap
+ * */
+static int exited(pid_t pid)
+{
+	siginfo_t info;
+
+	info.si_pid = 0;
+	if(waitid(P_PID, pid, &info, WEXITED | WNOHANG | WNOWAIT) == -1)
+		return 1;
+	return info.si_pid == pid;
+}
+
+/*
+ * RUN IGNORED SIGTERM
+ * */
+static void onKillTimer(int fd, void * data)
+{
+	struct Watch * w = data;
+	uint64_t expirations = 0;
+
+	if(read(fd, &expirations, sizeof(expirations)) == -1)
+		return;
+
+	if(w->pid > 0 && w->pidFd == -1 && exited(w->pid))
+		endRun(w);
+	if(w->pid > 0 && w->cancelled)
+		kill(w->pid, SIGKILL);
+}
+
+/*
+ * CHANGES SETTLED
+ * Start a run, or deal with the one in flight
+ * */
+static void onTimer(int fd, void * data)
+{
+	struct Watch * w = data;
+	uint64_t expirations = 0;
+
+	if(read(fd, &expirations, sizeof(expirations)) == -1)
+		return;
+	w->changing = 0;
+
+	if(w->pid > 0 && w->pidFd == -1 && exited(w->pid))
+		endRun(w);
+
+	if(w->pid > 0 || w->queued)
+	{
+		w->pending = 1;
+		if(w->policy == WATCH_CANCEL && w->pid > 0 && !w->cancelled)
+			cancelRun(w);
+		return;
+	}
+
+	startRun(w);
+}
+
+/*
+ * INOTIFY EVENTS
+ * Collect changed paths and restart the debounce
+ * */
+static void onEvents(int fd, void * data)
+{
+	struct Watch * w = data;
+	char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+	struct inotify_event * event = NULL;
+	ssize_t got = 0;
+	char * path = NULL;
+	int changes = 0;
+	int i = 0;
+	char * cur = NULL;
+
+	while((got = read(fd, buffer, sizeof(buffer))) > 0)
+	{
+		for(cur = buffer; cur < buffer + got; cur += sizeof(struct inotify_event) + event->len)
+		{
+			event = (struct inotify_event *)cur;
+
+			// Lost events, so anything watched may have changed
+			if(event->mask & IN_Q_OVERFLOW)
+			{
+				for(i = 0; i < w->numPaths; i++)
+				{
+					if(w->paths[i].wd != -1)
+						noteChange(w, w->paths[i].name ? joinPath(w->paths[i].path, w->paths[i].name)
+								: copyString(w->paths[i].path));
+				}
+				changes++;
+			}
+
+			// Paths can be added while looping, so index them
+			for(i = 0; i < w->numPaths; i++)
+			{
+				if(w->paths[i].wd != event->wd || event->wd == -1)
+					continue;
+
+				// Directory gone
+				if(event->mask & IN_IGNORED)
+				{
+					w->paths[i].wd = -1;
+					continue;
+				}
+				if(w->paths[i].name != NULL
+						&& (event->len == 0 || strcmp(w->paths[i].name, event->name)))
+					continue;
+
+				path = event->len ? joinPath(w->paths[i].path, event->name) : copyString(w->paths[i].path);
+				if(w->recursive && w->paths[i].name == NULL && (event->mask & IN_ISDIR)
+						&& (event->mask & (IN_CREATE | IN_MOVED_TO)))
+					watchTree(w, path);
+				noteChange(w, path);
+				changes++;
+			}
+		}
+	}
+
+	if(changes > 0)
+		armTimer(w);
+}
+
+/*
+ * STOP WATCH
+ * A run in flight carries on as a normal background job
+ * */
+static void stopWatch(struct Watch * w)
+{
+	int i = 0;
+
+	endRun(w);
+	evRemove(w->inFd);
+	evRemove(w->timerFd);
+	evRemove(w->killFd);
+	if(w->inFd != -1)
+		close(w->inFd);
+	if(w->timerFd != -1)
+		close(w->timerFd);
+	if(w->killFd != -1)
+		close(w->killFd);
+
+	for(i = 0; i < w->numPaths; i++)
+	{
+		free(w->paths[i].path);
+		free(w->paths[i].name);
+	}
+	for(i = 0; i < w->numChanged; i++)
+		free(w->changed[i]);
+	free(w->paths);
+	free(w->changed);
+	if(w->cmd.args != NULL)
+		destroyCmd(&w->cmd);
+	free(w);
+}
+
+/*
+ * STOP WATCH BY ID, OR ALL
+ * */
+static void killWatch(char * arg)
+{
+	struct Watch ** link = &watches;
+	struct Watch * w = NULL;
+	int id = atoi(arg);
+
+	if(!strcmp("all", arg))
+	{
+		freeWatches();
+		return;
+	}
+
+	while(*link != NULL)
+	{
+		if((*link)->id == id)
+		{
+			w = *link;
+			*link = w->next;
+			stopWatch(w);
+			return;
+		}
+		link = &(*link)->next;
+	}
+
+	outPrintf("watch: no watch %s\n", arg);
+}
+
+/*
+ * WATCH BUILTIN
+ * watch [-d MS] [-p queue|cancel] [-r] PATH... -- CMD [ARGS]
+ * watch            list watches
+ * watch -k ID|all  stop watches
+ * On success the watch keeps command's args, leaving command empty
+ * */
+void watchBuiltin(struct Cmd * command, struct LinkedList * procs, struct CmdQueue * queue)
+{
+	char ** args = command->args;
+	struct Watch * w = NULL;
+	int i = 1;
+	int dash = 0;
+	int recursive = 0;
+	int policy = WATCH_QUEUE;
+	long debounceMs = WATCH_DEBOUNCE_MS;
+
+	if(args[1] == NULL)
+	{
+		printWatches();
+		return;
+	}
+	if(!strcmp("-k", args[1]) && args[2] != NULL)
+	{
+		killWatch(args[2]);
+		return;
+	}
+
+	// Options
+	for(; args[i] != NULL && args[i][0] == '-' && strcmp("--", args[i]); i++)
+	{
+		if(!strcmp("-r", args[i]))
+			recursive = 1;
+		else if(!strcmp("-d", args[i]) && args[i + 1] != NULL && atol(args[i + 1]) > 0)
+			debounceMs = atol(args[++i]);
+		else if(!strcmp("-p", args[i]) && args[i + 1] != NULL && !strcmp("queue", args[i + 1]))
+		{
+			policy = WATCH_QUEUE;
+			i++;
+		}
+		else if(!strcmp("-p", args[i]) && args[i + 1] != NULL && !strcmp("cancel", args[i + 1]))
+		{
+			policy = WATCH_CANCEL;
+			i++;
+		}
+		else
+			break;
+	}
+
+	for(dash = i; args[dash] != NULL && strcmp("--", args[dash]); dash++);
+	if(dash == i || args[dash] == NULL || args[dash + 1] == NULL)
+	{
+		outPrintf("usage: watch [-d MS] [-p queue|cancel] [-r] PATH... -- COMMAND\n");
+		return;
+	}
+
+	w = calloc(1, sizeof(struct Watch));
+	if(w == NULL) exit(20);
+	w->pidFd = -1;
+	w->recursive = recursive;
+	w->policy = policy;
+	w->debounceMs = debounceMs;
+	w->procs = procs;
+	w->queue = queue;
+	w->inFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	w->timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	w->killFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	if(w->inFd == -1 || w->timerFd == -1 || w->killFd == -1)
+	{
+		outPrintf("watch: cannot watch files\n");
+		stopWatch(w);
+		return;
+	}
+
+	for(; i < dash; i++)
+	{
+		if(watchPath(w, args[i]) == -1)
+		{
+			outPrintf("watch: cannot watch %s\n", args[i]);
+			stopWatch(w);
+			return;
+		}
+	}
+
+	// Take the command, leaving only what's after --
+	w->cmd = *command;
+	initCmd(command);
+	shiftCmd(&w->cmd, dash + 1);
+	if(ss_prefixes(&w->cmd) == -1)
+	{
+		stopWatch(w);
+		return;
+	}
+
+	// Runs are background jobs, but their output is wanted
+	w->cmd.bgProc = 1;
+	w->cmd.stdoutFd = STDOUT_FILENO;
+
+	w->id = nextId++;
+	w->next = watches;
+	watches = w;
+	evAdd(w->inFd, onEvents, w);
+	evAdd(w->timerFd, onTimer, w);
+	evAdd(w->killFd, onKillTimer, w);
+	outPrintf("watch %d: watching %d director%s\n", w->id, w->numPaths, w->numPaths == 1 ? "y" : "ies");
+}
+
+/*
+ * NUMBER OF ACTIVE WATCHES
+ * */
+int watchCount(void)
+{
+	struct Watch * w = NULL;
+	int count = 0;
+
+	for(w = watches; w != NULL; w = w->next)
+		count++;
+
+	return count;
+}
+
+/*
+ * PRINT ACTIVE WATCHES
+ * */
+void printWatches(void)
+{
+	struct Watch * w = NULL;
+	int i = 0;
+
+	for(w = watches; w != NULL; w = w->next)
+	{
+		outPrintf("watch %d:", w->id);
+		for(i = 0; i < w->cmd.numArgs; i++)
+			outPrintf(" %s", w->cmd.args[i]);
+		outPrintf(" (%s, %ld ms", w->policy == WATCH_CANCEL ? "cancel" : "queue", w->debounceMs);
+		if(w->pid > 0)
+			outPrintf(", running pid %d", (int)w->pid);
+		else if(w->queued)
+			outPrintf(", queued");
+		outPrintf(")\n");
+	}
+}
+
+/*
+ * STOP ALL WATCHES
+ * */
+void freeWatches(void)
+{
+	struct Watch * w = NULL;
+
+	while(watches != NULL)
+	{
+		w = watches;
+		watches = w->next;
+		stopWatch(w);
+	}
+}
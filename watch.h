@@ -0,0 +1,50 @@
+/*
+ * WATCH HEADER FILE
+ *
+ * Re-run a command when files change
+ * "watch PATHS -- cmd" watches the paths with inotify from the event
+ * loop, waits for a burst of changes to settle, then runs cmd as a
+ * background job with the changed paths in $SMALLSH_CHANGED.
+ *
+ * Exit Error 20 indicates error with malloc
+ * */
+
+#ifndef WATCH_H
+#define WATCH_H
+
+// Header files
+#include <stdio.h>
+#include <stdlib.h>
+#include "cmd.h"
+#include "linkedList.h"
+#include "cmdQueue.h"
+
+// Constants
+// Quiet time before a run starts
+#ifndef WATCH_DEBOUNCE_MS
+#define WATCH_DEBOUNCE_MS 200
+#endif
+
+// Constant changes still start a run after this many debounce periods
+#ifndef WATCH_MAX_DEBOUNCES
+#define WATCH_MAX_DEBOUNCES 10
+#endif
+
+// Changed paths passed to one run, the rest are dropped
+#ifndef WATCH_MAX_CHANGED
+#define WATCH_MAX_CHANGED 256
+#endif
+
+#define WATCH_ENV "SMALLSH_CHANGED"
+
+// What to do with a run still going when more changes come in
+#define WATCH_QUEUE 0			// Run again once it's done
+#define WATCH_CANCEL 1			// Stop it with SIGTERM (SIGKILL after grace), then run again
+
+// Function prototypes
+void watchBuiltin(struct Cmd * command, struct LinkedList * procs, struct CmdQueue * queue);	// watch builtin, may keep command
+int watchCount(void);												// Number of active watches
+void printWatches(void);											// Print active watches
+void freeWatches(void);												// Stop all watches
+
+#endif